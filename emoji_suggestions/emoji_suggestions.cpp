@@ -104,6 +104,18 @@ bool IsLetterOrNumber(utf16char ch) {
 
 using Replacement = internal::Replacement;
 
+// Items matched by the last queries, each longer query is matched
+// only against the items found for the longest cached prefix of it.
+struct MatchedItems {
+	int querySize = 0;
+	std::vector<const Replacement*> items;
+};
+struct MatchedCache {
+	std::vector<utf16char> query;
+	std::vector<MatchedItems> steps;
+};
+thread_local MatchedCache Matched;
+
 class Completer {
 public:
 	Completer(utf16string query);
@@ -122,7 +134,9 @@ private:
 	bool isBetterThanLastResult(const Replacement *replacement) const;
 	void processInitialList();
 	void filterInitialList();
-	void initWordsTracking();
+	const std::vector<const Replacement*> &findCandidates();
+	void rememberMatched(std::vector<const Replacement*> &&items);
+	void initWordsTracking(const std::vector<const Replacement*> &list);
 	bool matchQueryForCurrentItem();
 	bool matchQueryTailStartingFrom(int position);
 	string_span findWordsStartingWith(utf16char ch);
@@ -275,9 +289,10 @@ void Completer::processInitialList() {
 	}
 }
 
-void Completer::initWordsTracking() {
+void Completer::initWordsTracking(
+		const std::vector<const Replacement*> &list) {
 	auto maxWordsCount = 0;
-	for (auto item : *_initialList) {
+	for (auto item : list) {
 		auto wordsCount = item->words.size();
 		if (maxWordsCount < wordsCount) {
 			maxWordsCount = wordsCount;
@@ -287,15 +302,41 @@ void Completer::initWordsTracking() {
 }
 
 void Completer::filterInitialList() {
-	initWordsTracking();
-	for (auto item : *_initialList) {
+	const auto &candidates = findCandidates();
+	auto matched = std::vector<const Replacement*>();
+	initWordsTracking(candidates);
+	for (auto item : candidates) {
 		_currentItemWords = string_span(item->words);
 		_currentItemWordsUsedCount = 1;
 		if (matchQueryForCurrentItem()) {
 			addResult(item);
+			matched.push_back(item);
 		}
 		_currentItemWordsUsedCount = 0;
 	}
+	rememberMatched(std::move(matched));
+}
+
+// Anything matching a query matches all of its prefixes as well.
+const std::vector<const Replacement*> &Completer::findCandidates() {
+	auto &cache = Matched;
+	const auto common = std::mismatch(
+		std::begin(cache.query),
+		std::end(cache.query),
+		std::begin(_query),
+		std::end(_query)).first - std::begin(cache.query);
+	while (!cache.steps.empty() && cache.steps.back().querySize > common) {
+		cache.steps.pop_back();
+	}
+	cache.query = _query;
+	return cache.steps.empty() ? *_initialList : cache.steps.back().items;
+}
+
+void Completer::rememberMatched(std::vector<const Replacement*> &&items) {
+	auto &cache = Matched;
+	if (cache.steps.empty() || cache.steps.back().querySize < _querySize) {
+		cache.steps.push_back({ _querySize, std::move(items) });
+	}
 }
 
 bool Completer::matchQueryForCurrentItem() {
@@ -0,0 +1,67 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#include "tests_support.h"
+
+#include "ui/emoji_config.h"
+
+#include <array>
+
+namespace {
+
+namespace Emoji = Ui::Emoji;
+
+// Emoji::Find() checks the first code unit table before the full search,
+// so it should find the same as the search itself.
+[[nodiscard]] bool FindsSame(const QString &text) {
+	auto length = 0;
+	auto directLength = 0;
+	const auto found = Emoji::Find(text, &length);
+	const auto direct = Emoji::internal::Find(
+		text.constBegin(),
+		text.constEnd(),
+		&directLength);
+	return (found == direct) && (!found || length == directLength);
+}
+
+void TestEveryEmojiIsFound() {
+	for (auto i = 0, count = Emoji::internal::FullCount(); i != count; ++i) {
+		const auto emoji = Emoji::internal::ByIndex(i);
+		const auto text = emoji->text();
+		UI_TEST_CHECK(Emoji::Find(text) != nullptr);
+		UI_TEST_CHECK(FindsSame(text));
+		UI_TEST_CHECK(FindsSame(emoji->id()));
+		UI_TEST_CHECK(FindsSame(
+			QString(text).remove(QChar(Emoji::kPostfix))));
+	}
+}
+
+void TestEveryCodeUnitIsFoundSame() {
+	const auto suffixes = std::array{
+		QString(),
+		QString(QChar(Emoji::kPostfix)),
+		QString(QChar(0x20E3)), // Keycap.
+		QString(QChar(Emoji::kPostfix)) + QChar(0x20E3),
+		QString(QChar(0xDE00)), // Low surrogates.
+		QString(QChar(0xDC4D)),
+		QString(QChar(0xDFFB)),
+	};
+	for (auto i = 0; i != 0x10000; ++i) {
+		const auto ch = QChar(ushort(i));
+		for (const auto &suffix : suffixes) {
+			UI_TEST_CHECK(FindsSame(ch + suffix));
+		}
+	}
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+	auto environment = Ui::Tests::Environment(argc, argv);
+	TestEveryEmojiIsFound();
+	TestEveryCodeUnitIsFoundSame();
+	return environment.finish();
+}
@@ -0,0 +1,68 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#include "tests_support.h"
+
+#include "ui/image/image_prepare.h"
+
+#include <random>
+
+namespace {
+
+constexpr auto kIterations = 10;
+
+[[nodiscard]] QImage RandomImage(int size) {
+	auto result = QImage(
+		QSize(size, size),
+		QImage::Format_ARGB32_Premultiplied);
+	auto generator = std::mt19937(size);
+	const auto ints = reinterpret_cast<uint32*>(result.bits());
+	for (auto i = 0, count = size * size; i != count; ++i) {
+		ints[i] = uint32(generator()) | 0xFF000000U;
+	}
+	return result;
+}
+
+void Run(int size) {
+	const auto image = RandomImage(size);
+	const auto name = [&](const char *what, int radius = 0) {
+		return QByteArray::number(size)
+			+ ' '
+			+ what
+			+ (radius ? " " + QByteArray::number(radius) : QByteArray());
+	};
+	Ui::Tests::Report(name("Blur"), Ui::Tests::Measure(
+		kIterations,
+		[&] { [[maybe_unused]] const auto result = Images::Blur(QImage(image)); }));
+	for (const auto radius : { 8, 32, 100 }) {
+		Ui::Tests::Report(name("BlurLargeImage", radius), Ui::Tests::Measure(
+			kIterations,
+			[&] {
+				auto copy = image.copy();
+				[[maybe_unused]] const auto result = Images::BlurLargeImage(
+					std::move(copy),
+					radius);
+			}));
+		Ui::Tests::Report(name("BlurLargeImageFast", radius), Ui::Tests::Measure(
+			kIterations,
+			[&] {
+				auto copy = image.copy();
+				[[maybe_unused]] const auto result = Images::BlurLargeImageFast(
+					std::move(copy),
+					radius);
+			}));
+	}
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+	auto environment = Ui::Tests::Environment(argc, argv);
+	for (const auto size : { 256, 1024, 2048 }) {
+		Run(size);
+	}
+	return environment.finish();
+}
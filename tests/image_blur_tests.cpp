@@ -0,0 +1,549 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#include "tests_support.h"
+
+#include "ui/image/image_prepare.h"
+#include "ui/painter.h"
+
+#include <QtGui/QPainter>
+
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+namespace {
+
+// Images::Blur and Images::BlurLargeImage as they were before the blur
+// was split in parts and moved to the vector sums, for the exact checks.
+namespace Old {
+
+TG_FORCE_INLINE uint64 BlurGetColors(const uchar *p) {
+	return (uint64)p[0]
+		+ ((uint64)p[1] << 16)
+		+ ((uint64)p[2] << 32)
+		+ ((uint64)p[3] << 48);
+}
+
+[[nodiscard]] QImage Blur(QImage &&image, bool ignoreAlpha) {
+	if (image.isNull()) {
+		return std::move(image);
+	}
+	const auto ratio = image.devicePixelRatio();
+	const auto format = image.format();
+	if (format != QImage::Format_RGB32
+		&& format != QImage::Format_ARGB32_Premultiplied) {
+		image = std::move(image).convertToFormat(
+			QImage::Format_ARGB32_Premultiplied);
+		image.setDevicePixelRatio(ratio);
+	}
+
+	auto pix = image.bits();
+	if (!pix) {
+		return std::move(image);
+	}
+	const auto w = image.width();
+	const auto h = image.height();
+	const auto radius = 3;
+	const auto r1 = radius + 1;
+	const auto div = radius * 2 + 1;
+	const auto stride = w * 4;
+	if (radius >= 16 || div >= w || div >= h || stride > w * 4) {
+		return std::move(image);
+	}
+	const auto withalpha = !ignoreAlpha && image.hasAlphaChannel();
+	if (withalpha) {
+		auto smaller = QImage(image.size(), image.format());
+		{
+			QPainter p(&smaller);
+			PainterHighQualityEnabler hq(p);
+
+			p.setCompositionMode(QPainter::CompositionMode_Source);
+			p.fillRect(0, 0, w, h, Qt::transparent);
+			p.drawImage(
+				QRect(radius, radius, w - 2 * radius, h - 2 * radius),
+				image,
+				QRect(0, 0, w, h));
+		}
+		smaller.setDevicePixelRatio(ratio);
+		auto was = std::exchange(image, base::take(smaller));
+		Assert(!image.isNull());
+
+		pix = image.bits();
+		if (!pix) return was;
+	}
+	const auto buffer = std::make_unique<uint64[]>(w * h);
+	const auto rgb = buffer.get();
+
+	int x, y, i;
+
+	int yw = 0;
+	const int we = w - r1;
+	for (y = 0; y < h; y++) {
+		uint64 cur = BlurGetColors(&pix[yw]);
+		uint64 rgballsum = -radius * cur;
+		uint64 rgbsum = cur * ((r1 * (r1 + 1)) >> 1);
+
+		for (i = 1; i <= radius; i++) {
+			uint64 cur = BlurGetColors(&pix[yw + i * 4]);
+			rgbsum += cur * (r1 - i);
+			rgballsum += cur;
+		}
+
+		x = 0;
+
+#define update(start, middle, end) \
+rgb[y * w + x] = (rgbsum >> 4) & 0x00FF00FF00FF00FFLL; \
+rgballsum += BlurGetColors(&pix[yw + (start) * 4]) - 2 * BlurGetColors(&pix[yw + (middle) * 4]) + BlurGetColors(&pix[yw + (end) * 4]); \
+rgbsum += rgballsum; \
+x++;
+
+		while (x < r1) {
+			update(0, x, x + r1);
+		}
+		while (x < we) {
+			update(x - r1, x, x + r1);
+		}
+		while (x < w) {
+			update(x - r1, x, w - 1);
+		}
+
+#undef update
+
+		yw += stride;
+	}
+
+	const int he = h - r1;
+	for (x = 0; x < w; x++) {
+		uint64 rgballsum = -radius * rgb[x];
+		uint64 rgbsum = rgb[x] * ((r1 * (r1 + 1)) >> 1);
+		for (i = 1; i <= radius; i++) {
+			rgbsum += rgb[i * w + x] * (r1 - i);
+			rgballsum += rgb[i * w + x];
+		}
+
+		y = 0;
+		int yi = x * 4;
+
+#define update(start, middle, end) \
+uint64 res = rgbsum >> 4; \
+pix[yi] = res & 0xFF; \
+pix[yi + 1] = (res >> 16) & 0xFF; \
+pix[yi + 2] = (res >> 32) & 0xFF; \
+pix[yi + 3] = (res >> 48) & 0xFF; \
+rgballsum += rgb[x + (start) * w] - 2 * rgb[x + (middle) * w] + rgb[x + (end) * w]; \
+rgbsum += rgballsum; \
+y++; \
+yi += stride;
+
+		while (y < r1) {
+			update(0, y, y + r1);
+		}
+		while (y < he) {
+			update(y - r1, y, y + r1);
+		}
+		while (y < h) {
+			update(y - r1, y, h - 1);
+		}
+
+#undef update
+	}
+
+	return std::move(image);
+}
+
+[[nodiscard]] QImage BlurLargeImage(QImage &&image, int radius) {
+	const auto width = image.width();
+	const auto height = image.height();
+	if (width <= radius || height <= radius || radius < 1) {
+		return std::move(image);
+	}
+
+	if (image.format() != QImage::Format_RGB32
+		&& image.format() != QImage::Format_ARGB32_Premultiplied) {
+		image = std::move(image).convertToFormat(
+			QImage::Format_ARGB32_Premultiplied);
+	}
+	const auto pixels = image.bits();
+
+	const auto width_m1 = width - 1;
+	const auto height_m1 = height - 1;
+	const auto widthxheight = width * height;
+	const auto div = 2 * radius + 1;
+	const auto radius_p1 = radius + 1;
+	const auto divsum = radius_p1 * radius_p1;
+
+	const auto dvcount = 256 * divsum;
+	const auto buffers = (div * 3) // stack
+		+ std::max(width, height) // vmin
+		+ widthxheight * 3 // rgb
+		+ dvcount; // dv
+	auto storage = std::vector<int>(buffers);
+	auto taken = 0;
+	const auto take = [&](int size) {
+		const auto result = gsl::make_span(storage).subspan(taken, size);
+		taken += size;
+		return result;
+	};
+
+	// Small buffers
+	const auto stack = take(div * 3).data();
+	const auto vmin = take(std::max(width, height)).data();
+
+	// Large buffers
+	const auto rgb = take(widthxheight * 3).data();
+	const auto dvs = take(dvcount);
+
+	auto &&ints = ranges::views::ints;
+	for (auto &&[value, index] : ranges::views::zip(dvs, ints(0, ranges::unreachable))) {
+		value = (index / divsum);
+	}
+	const auto dv = dvs.data();
+
+	// Variables
+	auto stackpointer = 0;
+	for (const auto x : ints(0, width)) {
+		vmin[x] = std::min(x + radius_p1, width_m1);
+	}
+	for (const auto y : ints(0, height)) {
+		auto rinsum = 0;
+		auto ginsum = 0;
+		auto binsum = 0;
+		auto routsum = 0;
+		auto goutsum = 0;
+		auto boutsum = 0;
+		auto rsum = 0;
+		auto gsum = 0;
+		auto bsum = 0;
+
+		const auto y_width = y * width;
+		for (const auto i : ints(-radius, radius + 1)) {
+			const auto sir = &stack[(i + radius) * 3];
+			const auto x = std::clamp(i, 0, width_m1);
+			const auto offset = (y_width + x) * 4;
+			sir[0] = pixels[offset];
+			sir[1] = pixels[offset + 1];
+			sir[2] = pixels[offset + 2];
+
+			const auto rbs = radius_p1 - std::abs(i);
+			rsum += sir[0] * rbs;
+			gsum += sir[1] * rbs;
+			bsum += sir[2] * rbs;
+
+			if (i > 0) {
+				rinsum += sir[0];
+				ginsum += sir[1];
+				binsum += sir[2];
+			} else {
+				routsum += sir[0];
+				goutsum += sir[1];
+				boutsum += sir[2];
+			}
+		}
+		stackpointer = radius;
+
+		for (const auto x : ints(0, width)) {
+			const auto position = (y_width + x) * 3;
+			rgb[position] = dv[rsum];
+			rgb[position + 1] = dv[gsum];
+			rgb[position + 2] = dv[bsum];
+
+			rsum -= routsum;
+			gsum -= goutsum;
+			bsum -= boutsum;
+
+			const auto stackstart = (stackpointer - radius + div) % div;
+			const auto sir = &stack[stackstart * 3];
+
+			routsum -= sir[0];
+			goutsum -= sir[1];
+			boutsum -= sir[2];
+
+			const auto offset = (y_width + vmin[x]) * 4;
+			sir[0] = pixels[offset];
+			sir[1] = pixels[offset + 1];
+			sir[2] = pixels[offset + 2];
+			rinsum += sir[0];
+			ginsum += sir[1];
+			binsum += sir[2];
+
+			rsum += rinsum;
+			gsum += ginsum;
+			bsum += binsum;
+			{
+				stackpointer = (stackpointer + 1) % div;
+				const auto sir = &stack[stackpointer * 3];
+
+				routsum += sir[0];
+				goutsum += sir[1];
+				boutsum += sir[2];
+
+				rinsum -= sir[0];
+				ginsum -= sir[1];
+				binsum -= sir[2];
+			}
+		}
+	}
+
+	for (const auto y : ints(0, height)) {
+		vmin[y] = std::min(y + radius_p1, height_m1) * width;
+	}
+	for (const auto x : ints(0, width)) {
+		auto rinsum = 0;
+		auto ginsum = 0;
+		auto binsum = 0;
+		auto routsum = 0;
+		auto goutsum = 0;
+		auto boutsum = 0;
+		auto rsum = 0;
+		auto gsum = 0;
+		auto bsum = 0;
+		for (const auto i : ints(-radius, radius + 1)) {
+			const auto y = std::clamp(i, 0, height_m1);
+			const auto position = (y * width + x) * 3;
+			const auto sir = &stack[(i + radius) * 3];
+
+			sir[0] = rgb[position];
+			sir[1] = rgb[position + 1];
+			sir[2] = rgb[position + 2];
+
+			const auto rbs = radius_p1 - std::abs(i);
+			rsum += sir[0] * rbs;
+			gsum += sir[1] * rbs;
+			bsum += sir[2] * rbs;
+			if (i > 0) {
+				rinsum += sir[0];
+				ginsum += sir[1];
+				binsum += sir[2];
+			} else {
+				routsum += sir[0];
+				goutsum += sir[1];
+				boutsum += sir[2];
+			}
+		}
+		stackpointer = radius;
+		for (const auto y : ints(0, height)) {
+			const auto offset = (y * width + x) * 4;
+			pixels[offset] = dv[rsum];
+			pixels[offset + 1] = dv[gsum];
+			pixels[offset + 2] = dv[bsum];
+			rsum -= routsum;
+			gsum -= goutsum;
+			bsum -= boutsum;
+
+			const auto stackstart = (stackpointer - radius + div) % div;
+			const auto sir = &stack[stackstart * 3];
+
+			routsum -= sir[0];
+			goutsum -= sir[1];
+			boutsum -= sir[2];
+
+			const auto position = (vmin[y] + x) * 3;
+			sir[0] = rgb[position];
+			sir[1] = rgb[position + 1];
+			sir[2] = rgb[position + 2];
+
+			rinsum += sir[0];
+			ginsum += sir[1];
+			binsum += sir[2];
+
+			rsum += rinsum;
+			gsum += ginsum;
+			bsum += binsum;
+			{
+				stackpointer = (stackpointer + 1) % div;
+				const auto sir = &stack[stackpointer * 3];
+
+				routsum += sir[0];
+				goutsum += sir[1];
+				boutsum += sir[2];
+
+				rinsum -= sir[0];
+				ginsum -= sir[1];
+				binsum -= sir[2];
+			}
+		}
+	}
+	return std::move(image);
+}
+
+} // namespace Old
+
+// Peak signal to noise ratio of the downscaled blur against the exact
+// one. Sharp color blocks are the worst case, near 37 dB at radius 64.
+constexpr auto kMinPsnr = 35.;
+
+[[nodiscard]] QImage Blocks(QSize size, int block) {
+	auto result = QImage(size, QImage::Format_ARGB32_Premultiplied);
+	auto generator = std::mt19937(size.width() * 31 + block);
+	auto p = QPainter(&result);
+	for (auto y = 0; y < size.height(); y += block) {
+		for (auto x = 0; x < size.width(); x += block) {
+			p.fillRect(
+				x,
+				y,
+				block,
+				block,
+				QColor::fromRgb(uint32(generator()) | 0xFF000000U));
+		}
+	}
+	return result;
+}
+
+[[nodiscard]] QImage Shapes(QSize size) {
+	auto result = QImage(size, QImage::Format_ARGB32_Premultiplied);
+	auto gradient = QLinearGradient(
+		QPointF(),
+		QPointF(size.width(), size.height()));
+	gradient.setStops({
+		{ 0., QColor(20, 60, 200) },
+		{ 0.5, QColor(240, 200, 40) },
+		{ 1., QColor(120, 10, 90) },
+	});
+	auto p = QPainter(&result);
+	p.fillRect(result.rect(), gradient);
+	p.setRenderHint(QPainter::Antialiasing);
+	p.setPen(Qt::NoPen);
+	p.setBrush(Qt::white);
+	p.drawEllipse(QRect(QPoint(), size / 3).translated(
+		size.width() / 4,
+		size.height() / 5));
+	p.setBrush(Qt::black);
+	p.drawEllipse(QRect(QPoint(), size / 4).translated(
+		size.width() / 2,
+		size.height() / 2));
+	return result;
+}
+
+[[nodiscard]] double Psnr(const QImage &a, const QImage &b) {
+	const auto first = a.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+	const auto second = b.convertToFormat(
+		QImage::Format_ARGB32_Premultiplied);
+	auto squares = 0.;
+	auto count = 0;
+	for (auto y = 0; y != first.height(); ++y) {
+		const auto from = reinterpret_cast<const uchar*>(
+			first.constScanLine(y));
+		const auto to = reinterpret_cast<const uchar*>(
+			second.constScanLine(y));
+		for (auto x = 0; x != first.width() * 4; ++x) {
+			if ((x % 4) == 3) {
+				continue; // Alpha is kept by both.
+			}
+			const auto difference = double(from[x]) - to[x];
+			squares += difference * difference;
+			++count;
+		}
+	}
+	const auto mse = squares / std::max(count, 1);
+	return mse ? (10. * std::log10(255. * 255. / mse)) : 100.;
+}
+
+[[nodiscard]] QImage Noise(QSize size, QImage::Format format, int seed) {
+	auto result = QImage(size, QImage::Format_ARGB32);
+	auto generator = std::mt19937(seed);
+	for (auto y = 0; y != size.height(); ++y) {
+		const auto ints = reinterpret_cast<uint32*>(result.scanLine(y));
+		for (auto x = 0; x != size.width(); ++x) {
+			ints[x] = uint32(generator());
+		}
+	}
+	return std::move(result).convertToFormat(format);
+}
+
+// Sizes around the area where the passes are split between threads.
+[[nodiscard]] std::vector<QSize> ExactSizes() {
+	return {
+		QSize(5, 40), // Too narrow for Blur.
+		QSize(100, 300),
+		QSize(255, 255),
+		QSize(256, 256),
+		QSize(257, 257),
+		QSize(300, 200),
+		QSize(511, 129),
+		QSize(64, 1031),
+	};
+}
+
+// The vector sums are checked here, with LIB_UI_NO_SIMD_IMAGES the same
+// checks cover the plain struct sums. The NEON sums need an ARM build.
+void TestBlurIsExact() {
+	const auto formats = std::array{
+		QImage::Format_RGB32,
+		QImage::Format_ARGB32_Premultiplied,
+		QImage::Format_ARGB32,
+	};
+	auto seed = 0;
+	for (const auto format : formats) {
+		for (const auto size : ExactSizes()) {
+			const auto image = Noise(size, format, ++seed);
+			for (const auto ignoreAlpha : { false, true }) {
+				const auto expected = Old::Blur(image.copy(), ignoreAlpha);
+				const auto result = Images::Blur(image.copy(), ignoreAlpha);
+				UI_TEST_CHECK(result == expected);
+			}
+		}
+	}
+}
+
+void TestBlurLargeImageIsExact() {
+	const auto formats = std::array{
+		QImage::Format_RGB32,
+		QImage::Format_ARGB32_Premultiplied,
+	};
+	auto seed = 0;
+	for (const auto format : formats) {
+		for (const auto size : ExactSizes()) {
+			const auto image = Noise(size, format, ++seed);
+			for (const auto radius : { 1, 2, 3, 8, 16, 32, 64, 100, 127 }) {
+				const auto expected = Old::BlurLargeImage(image.copy(), radius);
+				const auto result = Images::BlurLargeImage(image.copy(), radius);
+				UI_TEST_CHECK(result == expected);
+			}
+		}
+	}
+}
+
+void TestDownscaledBlurIsClose() {
+	const auto images = {
+		std::pair{ "blocks 48", Blocks(QSize(640, 480), 48) },
+		std::pair{ "blocks 16", Blocks(QSize(1280, 720), 16) },
+		std::pair{ "shapes", Shapes(QSize(1024, 1024)) },
+	};
+	for (const auto &[name, image] : images) {
+		for (const auto radius : { 8, 16, 32, 64, 100 }) {
+			const auto exact = Images::BlurLargeImage(image.copy(), radius);
+			const auto fast = Images::BlurLargeImageFast(
+				image.copy(),
+				radius);
+			UI_TEST_CHECK(fast.size() == image.size());
+			const auto psnr = Psnr(exact, fast);
+			std::printf("%s radius %d: %.2f dB\n", name, radius, psnr);
+			UI_TEST_CHECK(psnr >= kMinPsnr);
+		}
+	}
+}
+
+void TestLargeRadiusFallsBackToExact() {
+	// Radius larger than the sides is left to the exact blur
+	// instead of returning a downscaled and upscaled copy.
+	const auto image = Blocks(QSize(100, 100), 10);
+	const auto exact = Images::BlurLargeImage(image.copy(), 200);
+	const auto fast = Images::BlurLargeImageFast(image.copy(), 200);
+	UI_TEST_CHECK(fast == exact);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+	auto environment = Ui::Tests::Environment(argc, argv);
+	TestBlurIsExact();
+	TestBlurLargeImageIsExact();
+	TestDownscaledBlurIsClose();
+	TestLargeRadiusFallsBackToExact();
+	return environment.finish();
+}
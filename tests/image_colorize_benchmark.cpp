@@ -0,0 +1,67 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#include "tests_support.h"
+
+#include "ui/image/image_prepare.h"
+#include "ui/style/style_core.h"
+
+#include <random>
+
+namespace {
+
+constexpr auto kIterations = 100;
+
+[[nodiscard]] QImage RandomImage(int size, QImage::Format format) {
+	auto result = QImage(
+		QSize(size, size),
+		QImage::Format_ARGB32_Premultiplied);
+	auto generator = std::mt19937(size);
+	const auto ints = reinterpret_cast<uint32*>(result.bits());
+	for (auto i = 0, count = size * size; i != count; ++i) {
+		ints[i] = uint32(generator()) | 0xFF000000U;
+	}
+	return std::move(result).convertToFormat(format);
+}
+
+void Run(int size) {
+	const auto name = [&](const char *what) {
+		return QByteArray::number(size) + ' ' + what;
+	};
+	const auto color = QColor(40, 120, 200, 160);
+	const auto mask = RandomImage(size, QImage::Format_ARGB32_Premultiplied);
+	const auto gray = RandomImage(size, QImage::Format_Grayscale8);
+	auto result = QImage(
+		QSize(size, size),
+		QImage::Format_ARGB32_Premultiplied);
+	Ui::Tests::Report(name("colorizeImage"), Ui::Tests::Measure(
+		kIterations,
+		[&] { style::colorizeImage(mask, color, &result); }));
+	Ui::Tests::Report(name("colorizeImage alpha"), Ui::Tests::Measure(
+		kIterations,
+		[&] { style::colorizeImage(mask, color, &result, {}, {}, true); }));
+	Ui::Tests::Report(name("colorizeImage gray"), Ui::Tests::Measure(
+		kIterations,
+		[&] { style::colorizeImage(gray, color, &result); }));
+	Ui::Tests::Report(name("Colored"), Ui::Tests::Measure(
+		kIterations,
+		[&] {
+			auto copy = mask.copy();
+			[[maybe_unused]] const auto colored = Images::Colored(
+				std::move(copy),
+				color);
+		}));
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+	auto environment = Ui::Tests::Environment(argc, argv);
+	for (const auto size : { 64, 512, 2048 }) {
+		Run(size);
+	}
+	return environment.finish();
+}
@@ -0,0 +1,223 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#include "tests_support.h"
+
+#include "ui/image/image_prepare.h"
+#include "ui/effects/animation_value.h"
+#include "ui/style/style_core.h"
+
+#include <array>
+#include <random>
+
+namespace {
+
+constexpr auto kMaxWidth = 37;
+constexpr auto kRandomColors = 64;
+
+// style::colorizeImage and Images::Colored as they were before the lines
+// were processed four pixels at a time, for the exact checks.
+namespace Old {
+
+void colorizeImage(
+		const QImage &src,
+		const QColor &color,
+		not_null<QImage*> outResult,
+		QRect srcRect,
+		QPoint dstPoint,
+		bool useAlpha) {
+	if (srcRect.isNull()) {
+		srcRect = src.rect();
+	} else {
+		Assert(src.rect().contains(srcRect));
+	}
+	auto width = srcRect.width();
+	auto height = srcRect.height();
+	Assert(outResult->rect().contains(QRect(dstPoint, srcRect.size())));
+	outResult->detach();
+
+	auto pattern = anim::shifted(color);
+
+	constexpr auto resultIntsPerPixel = 1;
+	auto resultIntsPerLine = (outResult->bytesPerLine() >> 2);
+	auto resultIntsAdded = resultIntsPerLine - width * resultIntsPerPixel;
+	auto resultInts = reinterpret_cast<uint32*>(outResult->bits())
+		+ (dstPoint.y() * resultIntsPerLine)
+		+ (dstPoint.x() * resultIntsPerPixel);
+	Assert(resultIntsAdded >= 0);
+	Assert(outResult->depth()
+		== static_cast<int>((resultIntsPerPixel * sizeof(uint32)) << 3));
+	Assert(outResult->bytesPerLine() == (resultIntsPerLine << 2));
+
+	auto maskBytesPerPixel = (src.depth() >> 3);
+	auto maskBytesPerLine = src.bytesPerLine();
+	auto maskBytesAdded = maskBytesPerLine - width * maskBytesPerPixel;
+	auto maskBytes = src.constBits()
+		+ (srcRect.y() * maskBytesPerLine)
+		+ (srcRect.x() * maskBytesPerPixel)
+		+ (useAlpha ? 3 : 0);
+	Assert(maskBytesAdded >= 0);
+	Assert(src.depth() == (maskBytesPerPixel << 3));
+	for (int y = 0; y != height; ++y) {
+		for (int x = 0; x != width; ++x) {
+			auto maskOpacity = static_cast<anim::ShiftedMultiplier>(*maskBytes) + 1;
+			*resultInts = anim::unshifted(pattern * maskOpacity);
+			maskBytes += maskBytesPerPixel;
+			resultInts += resultIntsPerPixel;
+		}
+		maskBytes += maskBytesAdded;
+		resultInts += resultIntsAdded;
+	}
+
+	outResult->setDevicePixelRatio(src.devicePixelRatio());
+}
+
+[[nodiscard]] QImage Colored(QImage &&image, QColor add) {
+	const auto format = image.format();
+	if (format != QImage::Format_RGB32
+		&& format != QImage::Format_ARGB32_Premultiplied) {
+		image = std::move(image).convertToFormat(
+			QImage::Format_ARGB32_Premultiplied);
+	}
+
+	if (const auto pix = image.bits()) {
+		const auto ca = add.alpha();
+		const auto cr = add.red() * (ca + 1);
+		const auto cg = add.green() * (ca + 1);
+		const auto cb = add.blue() * (ca + 1);
+		const auto ra = (0x100 - ca) * 0x100;
+		const auto w = image.width();
+		const auto h = image.height();
+		const auto add = image.bytesPerLine() - (w * 4);
+		auto i = index_type();
+		for (auto y = 0; y != h; ++y) {
+			for (auto to = i + (w * 4); i != to; i += 4) {
+				const auto a = pix[i + 3] + 1;
+				pix[i + 0] = (ra * pix[i + 0] + a * cb) >> 16;
+				pix[i + 1] = (ra * pix[i + 1] + a * cg) >> 16;
+				pix[i + 2] = (ra * pix[i + 2] + a * cr) >> 16;
+			}
+			i += add;
+		}
+	}
+	return std::move(image);
+}
+
+} // namespace Old
+
+[[nodiscard]] QImage Noise(QSize size, QImage::Format format, int seed) {
+	auto result = QImage(size, QImage::Format_ARGB32);
+	auto generator = std::mt19937(seed);
+	for (auto y = 0; y != size.height(); ++y) {
+		const auto ints = reinterpret_cast<uint32*>(result.scanLine(y));
+		for (auto x = 0; x != size.width(); ++x) {
+			ints[x] = uint32(generator());
+		}
+	}
+	return std::move(result).convertToFormat(format);
+}
+
+[[nodiscard]] std::vector<QColor> Colors() {
+	auto result = std::vector<QColor>{
+		QColor(0, 0, 0, 0),
+		QColor(255, 255, 255, 255),
+		QColor(255, 255, 255, 0),
+		QColor(0, 0, 0, 255),
+		QColor(255, 0, 128, 128),
+		QColor(1, 254, 127, 1),
+		QColor(254, 1, 128, 254),
+	};
+	auto generator = std::mt19937(7);
+	for (auto i = 0; i != kRandomColors; ++i) {
+		const auto value = uint32(generator());
+		result.push_back(QColor(
+			value & 0xFF,
+			(value >> 8) & 0xFF,
+			(value >> 16) & 0xFF,
+			(value >> 24) & 0xFF));
+	}
+	return result;
+}
+
+// Every width up to kMaxWidth gives every tail after the vector steps,
+// the offsets give unaligned loads and stores. With LIB_UI_NO_SIMD_IMAGES
+// the plain loops are checked instead.
+void TestColorizeImageIsExact() {
+	struct Mask {
+		QImage::Format format = QImage::Format_ARGB32_Premultiplied;
+		bool useAlpha = false;
+	};
+	const auto masks = std::array{
+		Mask{ QImage::Format_ARGB32_Premultiplied, false },
+		Mask{ QImage::Format_ARGB32_Premultiplied, true },
+		Mask{ QImage::Format_Grayscale8, false },
+	};
+	const auto colors = Colors();
+	auto seed = 0;
+	for (const auto &mask : masks) {
+		const auto source = Noise(
+			QSize(kMaxWidth + 3, 3),
+			mask.format,
+			++seed);
+		const auto canvas = Noise(
+			QSize(kMaxWidth + 2, 4),
+			QImage::Format_ARGB32_Premultiplied,
+			++seed);
+		for (const auto &color : colors) {
+			for (auto width = 1; width <= kMaxWidth; ++width) {
+				const auto offset = (width % 4);
+				const auto rect = QRect(offset, 0, width, 3);
+				const auto point = QPoint(width % 3, 1);
+				auto expected = canvas.copy();
+				auto result = canvas.copy();
+				Old::colorizeImage(
+					source,
+					color,
+					&expected,
+					rect,
+					point,
+					mask.useAlpha);
+				style::colorizeImage(
+					source,
+					color,
+					&result,
+					rect,
+					point,
+					mask.useAlpha);
+				UI_TEST_CHECK(result == expected);
+			}
+		}
+	}
+}
+
+void TestColoredIsExact() {
+	const auto formats = std::array{
+		QImage::Format_RGB32,
+		QImage::Format_ARGB32_Premultiplied,
+		QImage::Format_ARGB32,
+	};
+	const auto colors = Colors();
+	auto seed = 0;
+	for (const auto format : formats) {
+		for (auto width = 1; width <= kMaxWidth; ++width) {
+			const auto image = Noise(QSize(width, 3), format, ++seed);
+			for (const auto &color : colors) {
+				const auto expected = Old::Colored(image.copy(), color);
+				const auto result = Images::Colored(image.copy(), color);
+				UI_TEST_CHECK(result == expected);
+			}
+		}
+	}
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+	auto environment = Ui::Tests::Environment(argc, argv);
+	TestColorizeImageIsExact();
+	TestColoredIsExact();
+	return environment.finish();
+}
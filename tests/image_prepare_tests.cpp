@@ -0,0 +1,278 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#include "tests_support.h"
+
+#include "ui/image/image_prepare.h"
+#include "ui/style/style_core.h"
+#include "styles/palette.h"
+
+#include <QtGui/QPainter>
+
+#include <array>
+#include <random>
+
+namespace {
+
+using Images::Option;
+
+// Images::Prepare as it was before the single pass composition:
+// the scaled image is painted with QPainter on a new canvas.
+//
+// The old canvas was left uninitialized when the image covered it,
+// so a translucent image was blended over garbage. Here it is cleared,
+// which is what the new path gives in that case.
+[[nodiscard]] QImage ReferencePrepare(
+		QImage image,
+		int w,
+		int h,
+		const Images::PrepareArgs &args) {
+	if (w <= 0
+		|| (w == image.width() && (h <= 0 || h == image.height()))) {
+	} else if (h <= 0) {
+		image = image.scaledToWidth(
+			w,
+			((args.options & Images::Option::FastTransform)
+				? Qt::FastTransformation
+				: Qt::SmoothTransformation));
+	} else {
+		image = image.scaled(
+			w,
+			h,
+			Qt::IgnoreAspectRatio,
+			((args.options & Images::Option::FastTransform)
+				? Qt::FastTransformation
+				: Qt::SmoothTransformation));
+	}
+	auto outer = args.outer;
+	if (!outer.isEmpty()) {
+		const auto ratio = style::DevicePixelRatio();
+		outer *= ratio;
+		if (outer != QSize(w, h)) {
+			image.setDevicePixelRatio(ratio);
+			auto result = QImage(outer, QImage::Format_ARGB32_Premultiplied);
+			result.setDevicePixelRatio(ratio);
+			result.fill(Qt::transparent);
+			{
+				QPainter p(&result);
+				if (!(args.options & Images::Option::TransparentBackground)) {
+					if (w < outer.width() || h < outer.height()) {
+						p.fillRect(
+							QRect({}, result.size() / ratio),
+							Qt::black);
+					}
+				}
+				p.drawImage(
+					(result.width() - image.width()) / (2 * ratio),
+					(result.height() - image.height()) / (2 * ratio),
+					image);
+			}
+			image = std::move(result);
+		}
+	}
+
+	if (args.options
+		& (Option::RoundCircle | Option::RoundLarge | Option::RoundSmall)) {
+		image = Images::Round(std::move(image), args.options);
+	}
+	if (args.colored) {
+		image = Images::Colored(std::move(image), *args.colored);
+	}
+	image.setDevicePixelRatio(style::DevicePixelRatio());
+	return image;
+}
+
+// Images::Circle as it was before only the edge spans were touched:
+// the full ellipse mask is painted over the target with DestinationIn.
+[[nodiscard]] QImage ReferenceCircle(QImage image, QRect target) {
+	if (target.isNull()) {
+		target = QRect(QPoint(), image.size());
+	}
+	image = std::move(image).convertToFormat(
+		QImage::Format_ARGB32_Premultiplied);
+	const auto ratio = image.devicePixelRatio();
+	auto p = QPainter(&image);
+	p.setCompositionMode(QPainter::CompositionMode_DestinationIn);
+	p.drawImage(
+		QRectF(target.topLeft() / ratio, target.size() / ratio),
+		Images::EllipseMask(target.size(), 1.));
+	p.end();
+	return image;
+}
+
+[[nodiscard]] QImage Noise(QSize size, QImage::Format format, int seed) {
+	auto result = QImage(size, QImage::Format_ARGB32);
+	auto generator = std::mt19937(seed);
+	for (auto y = 0; y != size.height(); ++y) {
+		const auto ints = reinterpret_cast<uint32*>(result.scanLine(y));
+		for (auto x = 0; x != size.width(); ++x) {
+			ints[x] = uint32(generator());
+		}
+	}
+	return (format == QImage::Format_ARGB32)
+		? result
+		: std::move(result).convertToFormat(format);
+}
+
+[[nodiscard]] bool Same(const QImage &a, const QImage &b) {
+	return (a.size() == b.size())
+		&& (a.convertToFormat(QImage::Format_ARGB32_Premultiplied)
+			== b.convertToFormat(QImage::Format_ARGB32_Premultiplied));
+}
+
+void TestPrepareMatchesReference() {
+	const auto formats = std::array{
+		QImage::Format_RGB32,
+		QImage::Format_ARGB32,
+		QImage::Format_ARGB32_Premultiplied,
+	};
+	const auto outer = QSize(64, 48);
+	const auto sizes = std::array{
+		QSize(40, 30), // Smaller than outer.
+		QSize(64, 48), // Same as outer.
+		QSize(96, 72), // Larger than outer.
+		QSize(96, 30), // Wider and lower.
+		QSize(40, 72), // Narrower and higher.
+	};
+	const auto optionsList = std::array<Images::Options, 5>{
+		Images::Options(),
+		Images::Options(Option::TransparentBackground),
+		Images::Options(Option::RoundCircle),
+		Option::RoundLarge | Option::TransparentBackground,
+		Option::RoundSmall | Option::FastTransform,
+	};
+	const auto colors = std::array<const style::color*, 2>{
+		nullptr,
+		&st::windowBgActive,
+	};
+	auto storage = QImage();
+	auto seed = 0;
+	for (const auto format : formats) {
+		const auto source = Noise(QSize(80, 60), format, ++seed);
+		for (const auto size : sizes) {
+			for (const auto options : optionsList) {
+				for (const auto colored : colors) {
+					for (const auto withOuter : { false, true }) {
+						const auto args = Images::PrepareArgs{
+							.colored = colored,
+							.options = options,
+							.outer = withOuter ? outer : QSize(),
+							.storage = &storage,
+						};
+						const auto expected = ReferencePrepare(
+							source,
+							size.width(),
+							size.height(),
+							args);
+						auto result = Images::Prepare(
+							source,
+							size.width(),
+							size.height(),
+							args);
+						UI_TEST_CHECK(Same(result, expected));
+
+						// The source must stay untouched.
+						UI_TEST_CHECK(source
+							== Noise(QSize(80, 60), format, seed));
+
+						// Hand the result back for the next call.
+						storage = std::move(result);
+					}
+				}
+			}
+		}
+	}
+}
+
+void TestCircleMatchesReference() {
+	const auto formats = std::array{
+		QImage::Format_RGB32,
+		QImage::Format_ARGB32,
+		QImage::Format_ARGB32_Premultiplied,
+	};
+	const auto sizes = std::array{
+		QSize(1, 1),
+		QSize(2, 2),
+		QSize(7, 7),
+		QSize(16, 16),
+		QSize(33, 21),
+		QSize(21, 33),
+		QSize(64, 64),
+		QSize(101, 57),
+	};
+	auto seed = 0;
+	for (const auto format : formats) {
+		for (const auto size : sizes) {
+			for (const auto ratio : { 1, 2 }) {
+				auto source = Noise(size + QSize(6, 4), format, ++seed);
+				source.setDevicePixelRatio(ratio);
+				const auto targets = std::array{
+					QRect(),
+					QRect(QPoint(3, 1), size),
+					QRect(QPoint(6, 4), size),
+				};
+				for (const auto target : targets) {
+					const auto expected = ReferenceCircle(source, target);
+					const auto result = Images::Circle(
+						QImage(source),
+						target);
+					UI_TEST_CHECK(result == expected);
+				}
+			}
+		}
+	}
+}
+
+void TestCircleEdgesAreCached() {
+	const auto image = Noise(
+		QSize(77, 55),
+		QImage::Format_ARGB32_Premultiplied,
+		7);
+	const auto was = Images::CachedMasksStatistics();
+	[[maybe_unused]] const auto first = Images::Circle(QImage(image));
+	const auto now = Images::CachedMasksStatistics();
+	UI_TEST_CHECK(now.misses == was.misses + 1);
+	[[maybe_unused]] const auto second = Images::Circle(QImage(image));
+	UI_TEST_CHECK(Images::CachedMasksStatistics().hits == now.hits + 1);
+}
+
+void TestStorageIsReused() {
+	const auto source = Noise(
+		QSize(40, 30),
+		QImage::Format_ARGB32_Premultiplied,
+		42);
+	auto storage = QImage(
+		QSize(64, 48),
+		QImage::Format_ARGB32_Premultiplied);
+	const auto bits = storage.constBits();
+	const auto result = Images::Prepare(source, 40, 30, {
+		.outer = QSize(64, 48),
+		.storage = &storage,
+	});
+	UI_TEST_CHECK(result.constBits() == bits);
+	UI_TEST_CHECK(storage.isNull());
+
+	// A shared storage is not written to.
+	auto shared = result;
+	const auto copy = shared;
+	const auto another = Images::Prepare(source, 40, 30, {
+		.outer = QSize(64, 48),
+		.storage = &shared,
+	});
+	UI_TEST_CHECK(another.constBits() != copy.constBits());
+	UI_TEST_CHECK(copy == result);
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+	auto environment = Ui::Tests::Environment(argc, argv);
+	TestPrepareMatchesReference();
+	TestStorageIsReused();
+	TestCircleMatchesReference();
+	TestCircleEdgesAreCached();
+	return environment.finish();
+}
@@ -0,0 +1,106 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#include "tests_support.h"
+
+#include "ui/widgets/fields/input_field.h"
+#include "styles/style_widgets.h"
+
+#include <QtGui/QTextCursor>
+#include <QtGui/QTextDocument>
+#include <QtWidgets/QTextEdit>
+
+#include <array>
+#include <random>
+
+namespace {
+
+using Ui::InputField;
+
+constexpr auto kEdits = 5000;
+
+[[nodiscard]] QString RandomText(std::mt19937 &generator) {
+	const auto chars = u"ab c\n"_q;
+	const auto length = std::uniform_int_distribution<int>(1, 6)(generator);
+	auto result = QString();
+	for (auto i = 0; i != length; ++i) {
+		result.append(chars[generator() % chars.size()]);
+	}
+	return result;
+}
+
+[[nodiscard]] TextWithTags InitialText() {
+	const auto text = u"first line\nsecond line\nthird\n\nfifth line"_q;
+	return {
+		text,
+		{
+			{ 6, 11, InputField::kTagBold }, // "line\nsecond"
+			{ 18, 11, InputField::kTagItalic }, // "line\nthird\n"
+			{ 30, 5, InputField::kTagBold }, // "fifth"
+		},
+	};
+}
+
+// Edits the document at random and compares the text with tags updated
+// from the changed paragraphs with the result of reading everything.
+void TestIncrementalMatchesFullWalk() {
+	const auto tags = std::array{
+		QString(),
+		InputField::kTagBold,
+		InputField::kTagItalic,
+		InputField::kTagStrikeOut,
+	};
+	auto generator = std::mt19937(42);
+	auto field = InputField(
+		nullptr,
+		st::defaultInputField,
+		InputField::Mode::MultiLine,
+		nullptr,
+		InitialText());
+	const auto edit = field.rawTextEdit();
+	const auto document = edit->document();
+	for (auto i = 0; i != kEdits; ++i) {
+		const auto length = document->characterCount() - 1;
+		const auto position = std::uniform_int_distribution<int>(
+			0,
+			length)(generator);
+		auto cursor = QTextCursor(document);
+		cursor.setPosition(position);
+		switch (generator() % 4) {
+		case 0: cursor.insertText(RandomText(generator)); break;
+		case 1: {
+			const auto till = std::uniform_int_distribution<int>(
+				position,
+				std::min(length, position + 8))(generator);
+			cursor.setPosition(till, QTextCursor::KeepAnchor);
+			cursor.removeSelectedText();
+		} break;
+		case 2: cursor.insertBlock(); break;
+		case 3: {
+			edit->setTextCursor(cursor);
+			field.insertTag(
+				RandomText(generator),
+				tags[generator() % tags.size()]);
+		} break;
+		}
+
+		const auto full = field.getTextWithTagsPart(0, -1);
+		const auto &incremental = field.getTextWithTags();
+		UI_TEST_CHECK(incremental.text == full.text);
+		UI_TEST_CHECK(incremental.tags == full.tags);
+		if (incremental != full) {
+			return;
+		}
+	}
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+	auto environment = Ui::Tests::Environment(argc, argv);
+	TestIncrementalMatchesFullWalk();
+	return environment.finish();
+}
@@ -0,0 +1,131 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#include "tests_support.h"
+
+#include "ui/style/style_core.h"
+#include "ui/text/text_custom_emoji.h"
+#include "ui/emoji_config.h"
+#include "styles/style_basic.h"
+
+#include <cstdio>
+
+namespace Ui::Tests {
+namespace {
+
+auto Failures = 0;
+
+class SquareEmoji final : public Text::CustomEmoji {
+public:
+	explicit SquareEmoji(const QString &data) : _data(data) {
+	}
+
+	int width() override {
+		return st::emojiSize;
+	}
+	QString entityData() override {
+		return _data;
+	}
+	void paint(QPainter &p, const Context &context) override {
+		const auto size = st::emojiSize;
+		p.fillRect(
+			QRect(context.position, QSize(size, size)),
+			context.textColor);
+	}
+	void unload() override {
+	}
+	bool ready() override {
+		return true;
+	}
+	bool readyInDefaultState() override {
+		return true;
+	}
+
+private:
+	QString _data;
+
+};
+
+} // namespace
+
+Environment::Environment(int &argc, char *argv[]) {
+	qputenv("QT_QPA_PLATFORM", "offscreen");
+	_application = std::make_unique<QApplication>(argc, argv);
+	Integration::Set(this);
+	style::StartManager(style::kScaleDefault);
+	Emoji::Init();
+}
+
+Environment::~Environment() {
+	Emoji::Clear();
+	style::StopManager();
+	_application = nullptr;
+}
+
+void Environment::postponeCall(FnMut<void()> &&callable) {
+	callable();
+}
+
+void Environment::registerLeaveSubscription(not_null<QWidget*> widget) {
+}
+
+void Environment::unregisterLeaveSubscription(not_null<QWidget*> widget) {
+}
+
+std::unique_ptr<Text::CustomEmoji> Environment::createCustomEmoji(
+		const QString &data,
+		const std::any &context) {
+	return std::make_unique<SquareEmoji>(data);
+}
+
+QString Environment::emojiCacheFolder() {
+	return _folder.path();
+}
+
+QString Environment::openglCheckFilePath() {
+	return _folder.filePath(u"opengl"_q);
+}
+
+QString Environment::angleBackendFilePath() {
+	return _folder.filePath(u"angle"_q);
+}
+
+int Environment::finish() const {
+	if (Failures) {
+		std::fprintf(stderr, "%d check(s) failed.\n", Failures);
+	}
+	return Failures ? 1 : 0;
+}
+
+void Check(
+		bool condition,
+		const char *expression,
+		const char *file,
+		int line) {
+	if (!condition) {
+		++Failures;
+		std::fprintf(
+			stderr,
+			"%s:%d: check failed: %s\n",
+			file,
+			line,
+			expression);
+	}
+}
+
+void Report(const QByteArray &name, double microseconds) {
+	std::printf("%-40s %12.2f us\n", name.constData(), microseconds);
+}
+
+void ReportSize(const QByteArray &name, int bytes) {
+	std::printf("%-40s %12d bytes\n", name.constData(), bytes);
+}
+
+void ReportAllocations(const QByteArray &name, double allocations) {
+	std::printf("%-40s %12.1f allocs\n", name.constData(), allocations);
+}
+
+} // namespace Ui::Tests
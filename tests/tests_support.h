@@ -0,0 +1,75 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#pragma once
+
+#include "ui/integration.h"
+
+#include <QtCore/QTemporaryDir>
+#include <QtWidgets/QApplication>
+
+#include <chrono>
+#include <memory>
+
+namespace Ui::Tests {
+
+// Offscreen application with the style manager and emoji started,
+// enough for laying out and painting text and images.
+class Environment final : public Integration {
+public:
+	Environment(int &argc, char *argv[]);
+	~Environment();
+
+	void postponeCall(FnMut<void()> &&callable) override;
+	void registerLeaveSubscription(not_null<QWidget*> widget) override;
+	void unregisterLeaveSubscription(not_null<QWidget*> widget) override;
+
+	// Custom emoji are plain squares of the emoji size.
+	std::unique_ptr<Text::CustomEmoji> createCustomEmoji(
+		const QString &data,
+		const std::any &context) override;
+
+	QString emojiCacheFolder() override;
+	QString openglCheckFilePath() override;
+	QString angleBackendFilePath() override;
+
+	// Returns the process exit code.
+	[[nodiscard]] int finish() const;
+
+private:
+	std::unique_ptr<QApplication> _application;
+	QTemporaryDir _folder;
+
+};
+
+void Check(
+	bool condition,
+	const char *expression,
+	const char *file,
+	int line);
+
+// Average duration of a single method() call in microseconds.
+template <typename Method>
+[[nodiscard]] double Measure(int iterations, Method &&method) {
+	using Clock = std::chrono::steady_clock;
+	method(); // Warm up.
+	const auto start = Clock::now();
+	for (auto i = 0; i != iterations; ++i) {
+		method();
+	}
+	const auto duration = std::chrono::duration<double, std::micro>(
+		Clock::now() - start);
+	return duration.count() / iterations;
+}
+
+void Report(const QByteArray &name, double microseconds);
+void ReportSize(const QByteArray &name, int bytes);
+void ReportAllocations(const QByteArray &name, double allocations);
+
+} // namespace Ui::Tests
+
+#define UI_TEST_CHECK(condition) \
+	::Ui::Tests::Check((condition), #condition, __FILE__, __LINE__)
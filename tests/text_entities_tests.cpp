@@ -0,0 +1,485 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#include "tests_support.h"
+
+#include "ui/text/text.h"
+#include "ui/text/text_entity.h"
+#include "base/qthelp_url.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QStack>
+
+#include <array>
+#include <random>
+
+namespace {
+
+using namespace TextUtilities;
+using namespace Ui::Text;
+
+constexpr auto kAllFlags = TextParseLinks
+	| TextParseMentions
+	| TextParseHashtags
+	| TextParseBotCommands;
+constexpr auto kRandomTexts = 20000;
+
+// ParseEntities as it was before the regular expression matches were
+// reused, searching with every expression again after each entity.
+void ReferenceParseEntities(TextWithEntities &result, int32 flags) {
+	constexpr auto kNotFound = std::numeric_limits<int>::max();
+
+	auto newEntities = EntitiesInText();
+	bool withHashtags = (flags & TextParseHashtags);
+	bool withMentions = (flags & TextParseMentions);
+	bool withBotCommands = (flags & TextParseBotCommands);
+
+	int existingEntityIndex = 0, existingEntitiesCount = result.entities.size();
+	int existingEntityEnd = 0;
+
+	int32 len = result.text.size();
+	const auto start = result.text.constData();
+	const auto end = start + result.text.size();
+	for (int32 offset = 0, matchOffset = offset, mentionSkip = 0; offset < len;) {
+		auto mDomain = qthelp::RegExpDomain().match(result.text, matchOffset);
+		auto mExplicitDomain = qthelp::RegExpDomainExplicit().match(result.text, matchOffset);
+		auto mHashtag = withHashtags ? RegExpHashtag().match(result.text, matchOffset) : QRegularExpressionMatch();
+		auto mMention = withMentions ? RegExpMention().match(result.text, qMax(mentionSkip, matchOffset)) : QRegularExpressionMatch();
+		auto mBotCommand = withBotCommands ? RegExpBotCommand().match(result.text, matchOffset) : QRegularExpressionMatch();
+
+		auto lnkType = EntityType::Url;
+		int32 lnkStart = 0, lnkLength = 0;
+		auto domainStart = mDomain.hasMatch() ? mDomain.capturedStart() : kNotFound,
+			domainEnd = mDomain.hasMatch() ? mDomain.capturedEnd() : kNotFound,
+			explicitDomainStart = mExplicitDomain.hasMatch() ? mExplicitDomain.capturedStart() : kNotFound,
+			explicitDomainEnd = mExplicitDomain.hasMatch() ? mExplicitDomain.capturedEnd() : kNotFound,
+			hashtagStart = mHashtag.hasMatch() ? mHashtag.capturedStart() : kNotFound,
+			hashtagEnd = mHashtag.hasMatch() ? mHashtag.capturedEnd() : kNotFound,
+			mentionStart = mMention.hasMatch() ? mMention.capturedStart() : kNotFound,
+			mentionEnd = mMention.hasMatch() ? mMention.capturedEnd() : kNotFound,
+			botCommandStart = mBotCommand.hasMatch() ? mBotCommand.capturedStart() : kNotFound,
+			botCommandEnd = mBotCommand.hasMatch() ? mBotCommand.capturedEnd() : kNotFound;
+		auto hashtagIgnore = false;
+		auto mentionIgnore = false;
+
+		if (mHashtag.hasMatch()) {
+			if (!mHashtag.capturedView(1).isEmpty()) {
+				++hashtagStart;
+			}
+			if (!mHashtag.capturedView(2).isEmpty()) {
+				--hashtagEnd;
+			}
+			if (RegExpHashtagExclude().match(
+				result.text.mid(
+					hashtagStart + 1,
+					hashtagEnd - hashtagStart - 1)).hasMatch()) {
+				hashtagIgnore = true;
+			}
+		}
+		while (mMention.hasMatch()) {
+			if (!mMention.capturedView(1).isEmpty()) {
+				++mentionStart;
+			}
+			if (!mMention.capturedView(2).isEmpty()) {
+				--mentionEnd;
+			}
+			if (!(start + mentionStart + 1)->isLetter() || !(start + mentionEnd - 1)->isLetterOrNumber()) {
+				mentionSkip = mentionEnd;
+				if (mentionSkip < len
+					&& (start + mentionSkip)->isLowSurrogate()) {
+					++mentionSkip;
+				}
+				mMention = RegExpMention().match(result.text, qMax(mentionSkip, matchOffset));
+				if (mMention.hasMatch()) {
+					mentionStart = mMention.capturedStart();
+					mentionEnd = mMention.capturedEnd();
+				} else {
+					mentionIgnore = true;
+				}
+			} else {
+				break;
+			}
+		}
+		if (mBotCommand.hasMatch()) {
+			if (!mBotCommand.capturedView(1).isEmpty()) {
+				++botCommandStart;
+			}
+			if (!mBotCommand.capturedView(3).isEmpty()) {
+				--botCommandEnd;
+			}
+		}
+		if (!mDomain.hasMatch()
+			&& !mExplicitDomain.hasMatch()
+			&& !mHashtag.hasMatch()
+			&& !mMention.hasMatch()
+			&& !mBotCommand.hasMatch()) {
+			break;
+		}
+
+		if (explicitDomainStart < domainStart) {
+			domainStart = explicitDomainStart;
+			domainEnd = explicitDomainEnd;
+			mDomain = mExplicitDomain;
+		}
+		if (mentionStart < hashtagStart
+			&& mentionStart < domainStart
+			&& mentionStart < botCommandStart) {
+			if (mentionIgnore) {
+				offset = matchOffset = mentionEnd;
+				continue;
+			}
+
+			lnkType = EntityType::Mention;
+			lnkStart = mentionStart;
+			lnkLength = mentionEnd - mentionStart;
+		} else if (hashtagStart < domainStart
+			&& hashtagStart < botCommandStart) {
+			if (hashtagIgnore) {
+				offset = matchOffset = hashtagEnd;
+				continue;
+			}
+
+			lnkType = EntityType::Hashtag;
+			lnkStart = hashtagStart;
+			lnkLength = hashtagEnd - hashtagStart;
+		} else if (botCommandStart < domainStart) {
+			lnkType = EntityType::BotCommand;
+			lnkStart = botCommandStart;
+			lnkLength = botCommandEnd - botCommandStart;
+		} else {
+			auto protocol = mDomain.captured(1).toLower();
+			auto topDomain = mDomain.captured(3).toLower();
+			auto isProtocolValid = protocol.isEmpty() || IsValidProtocol(protocol);
+			auto isTopDomainValid = !protocol.isEmpty() || IsValidTopDomain(topDomain);
+
+			if (protocol.isEmpty() && domainStart > offset + 1 && *(start + domainStart - 1) == QChar('@')) {
+				auto forMailName = result.text.mid(offset, domainStart - offset - 1);
+				auto mMailName = RegExpMailNameAtEnd().match(forMailName);
+				if (mMailName.hasMatch()) {
+					auto mailStart = offset + mMailName.capturedStart();
+					if (mailStart < offset) {
+						mailStart = offset;
+					}
+					lnkType = EntityType::Email;
+					lnkStart = mailStart;
+					lnkLength = domainEnd - mailStart;
+				}
+			}
+			if (lnkType == EntityType::Url && !lnkLength) {
+				if (!isProtocolValid || !isTopDomainValid) {
+					matchOffset = domainEnd;
+					continue;
+				}
+				lnkStart = domainStart;
+
+				QStack<const QChar*> parenth;
+				const QChar *domainEnd = start + mDomain.capturedEnd(), *p = domainEnd;
+				for (; p < end; ++p) {
+					QChar ch(*p);
+					if (IsLinkEnd(ch)) {
+						break; // link finished
+					} else if (IsAlmostLinkEnd(ch)) {
+						const QChar *endTest = p + 1;
+						while (endTest < end && IsAlmostLinkEnd(*endTest)) {
+							++endTest;
+						}
+						if (endTest >= end || IsLinkEnd(*endTest)) {
+							break; // link finished at p
+						}
+						p = endTest;
+						ch = *p;
+					}
+					if (ch == '(' || ch == '[' || ch == '{' || ch == '<') {
+						parenth.push(p);
+					} else if (ch == ')' || ch == ']' || ch == '}' || ch == '>') {
+						if (parenth.isEmpty()) break;
+						const QChar *q = parenth.pop(), open(*q);
+						if ((ch == ')' && open != '(') || (ch == ']' && open != '[') || (ch == '}' && open != '{') || (ch == '>' && open != '<')) {
+							p = q;
+							break;
+						}
+					}
+				}
+				if (p > domainEnd) { // check, that domain ended
+					if (domainEnd->unicode() != '/' && domainEnd->unicode() != '?') {
+						matchOffset = domainEnd - start;
+						continue;
+					}
+				}
+				lnkLength = (p - start) - lnkStart;
+			}
+		}
+		for (; existingEntityIndex < existingEntitiesCount && result.entities[existingEntityIndex].offset() <= lnkStart; ++existingEntityIndex) {
+			auto &entity = result.entities[existingEntityIndex];
+			accumulate_max(existingEntityEnd, entity.offset() + entity.length());
+			newEntities.push_back(entity);
+		}
+		if (lnkStart >= existingEntityEnd) {
+			result.entities.push_back({ lnkType, lnkStart, lnkLength });
+		}
+
+		offset = matchOffset = lnkStart + lnkLength;
+	}
+	if (!newEntities.isEmpty()) {
+		for (; existingEntityIndex < existingEntitiesCount; ++existingEntityIndex) {
+			auto &entity = result.entities[existingEntityIndex];
+			newEntities.push_back(entity);
+		}
+		result.entities = newEntities;
+	}
+}
+
+[[nodiscard]] std::vector<QString> Fragments() {
+	return {
+		u" "_q,
+		u"  "_q,
+		u"\n"_q,
+		u"text"_q,
+		u"word."_q,
+		u", "_q,
+		u"@"_q,
+		u"#"_q,
+		u"/"_q,
+		u"@username"_q,
+		u"@user_name12"_q,
+		u"@a"_q,
+		u"@_bad"_q,
+		u"@9digits"_q,
+		u"#hashtag"_q,
+		u"#123"_q,
+		u"#tag_with_underscore"_q,
+		u"/start"_q,
+		u"/command@bot"_q,
+		u"/cmd_1"_q,
+		u"example.com"_q,
+		u"www.example.org/path?q=1&b=(2)"_q,
+		u"https://example.com"_q,
+		u"http://sub.domain.co.uk/a/b#frag"_q,
+		u"ftp://files.example.net"_q,
+		u"tg://resolve?domain=x"_q,
+		u"bad://example.com"_q,
+		u"example.invalidtld"_q,
+		u"mail@example.com"_q,
+		u"first.last@mail.example.org"_q,
+		u"(see t.me/channel)"_q,
+		u"[link.com]"_q,
+		u"<a.b.com>"_q,
+		u"\"quoted.com\""_q,
+		u"1.2.3.4"_q,
+		u"..."_q,
+		u"!?"_q,
+		QString::fromUtf8("\xD0\xBF\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82"),
+		QString::fromUtf8("@\xD0\xB8\xD0\xBC\xD1\x8F"),
+		QString::fromUtf8("#\xD1\x82\xD0\xB5\xD0\xB3"),
+		QString::fromUtf8("\xF0\x9F\x98\x80"),
+		QString::fromUtf8("@\xF0\x9F\x98\x80x"),
+		QString::fromUtf8("\xD0\xBF\xD1\x80\xD0\xB8\xD0\xBC\xD0\xB5\xD1\x80.\xD1\x80\xD1\x84"),
+	};
+}
+
+[[nodiscard]] std::vector<QString> Corpus() {
+	auto result = std::vector<QString>{
+		QString(),
+		u"Hello, @username! Check https://example.com and #news."_q,
+		u"/start@bot /help, then visit example.com/path?x=(1)."_q,
+		u"Mail me: first.last@mail.example.org, or @support."_q,
+		u"@a @ab @abc @abcd @abcde @abcdef"_q,
+		u"Links: a.com b.com c.com d.com e.com f.com g.com h.com"_q,
+		u"#a#b#c #d #e 123#f"_q,
+		u"(https://en.wikipedia.org/wiki/Foo_(bar)) and [x.com]"_q,
+		u"no entities in this plain sentence at all"_q,
+	};
+	const auto fragments = Fragments();
+	auto generator = std::mt19937(20241016);
+	auto fragment = std::uniform_int_distribution<int>(
+		0,
+		int(fragments.size()) - 1);
+	auto count = std::uniform_int_distribution<int>(1, 24);
+	for (auto i = 0; i != kRandomTexts; ++i) {
+		auto text = QString();
+		for (auto j = count(generator); j != 0; --j) {
+			text.append(fragments[fragment(generator)]);
+		}
+		result.push_back(std::move(text));
+	}
+	return result;
+}
+
+void CheckSame(const QString &text, int32 flags) {
+	auto existing = EntitiesInText();
+	if (text.size() > 4) {
+		// Entities that are already there must be kept as they are.
+		existing.push_back({ EntityType::Bold, 1, 3 });
+	}
+	auto expected = TextWithEntities{ text, existing };
+	auto parsed = TextWithEntities{ text, existing };
+	ReferenceParseEntities(expected, flags);
+	ParseEntities(parsed, flags);
+	UI_TEST_CHECK(parsed.text == expected.text);
+	UI_TEST_CHECK(parsed.entities == expected.entities);
+	if (parsed.entities != expected.entities) {
+		qWarning() << "Different entities for:" << text;
+	}
+}
+
+void TestParseEntitiesMatchesReference() {
+	const auto flags = std::array{
+		int32(kAllFlags),
+		int32(TextParseLinks),
+		int32(TextParseLinks | TextParseMentions),
+		int32(TextParseLinks | TextParseHashtags | TextParseBotCommands),
+	};
+	for (const auto &text : Corpus()) {
+		for (const auto flag : flags) {
+			CheckSame(text, flag);
+		}
+	}
+}
+
+[[nodiscard]] EntitiesInText RandomEntities(
+		std::mt19937 &generator,
+		int textLength,
+		int count) {
+	auto position = std::uniform_int_distribution<int>(0, textLength);
+	auto type = std::uniform_int_distribution<int>(
+		int(EntityType::Url),
+		int(EntityType::Spoiler));
+	auto data = std::uniform_int_distribution<int>(0, 3);
+	auto result = EntitiesInText();
+	for (auto i = 0; i != count; ++i) {
+		const auto offset = position(generator);
+		const auto length = std::uniform_int_distribution<int>(
+			0,
+			textLength - offset)(generator);
+		const auto index = data(generator);
+		result.push_back({
+			EntityType(type(generator)),
+			offset,
+			length,
+			index ? (u"data"_q + QString::number(index)) : QString(),
+		});
+	}
+	return result;
+}
+
+[[nodiscard]] TextWithTags::Tags ToTags(const EntitiesInText &entities) {
+	auto result = TextWithTags::Tags();
+	for (const auto &entity : entities) {
+		result.push_back({
+			entity.offset(),
+			entity.length(),
+			entity.data().isEmpty() ? u"tag"_q : entity.data(),
+		});
+	}
+	return result;
+}
+
+void TestCompactRoundTrip() {
+	auto generator = std::mt19937(20241016);
+	const auto check = [](const EntitiesInText &entities, int textLength) {
+		auto entitiesRead = EntitiesInText();
+		UI_TEST_CHECK(DeserializeEntitiesCompact(
+			SerializeEntitiesCompact(entities),
+			textLength,
+			entitiesRead));
+		UI_TEST_CHECK(entitiesRead == entities);
+
+		const auto tags = ToTags(entities);
+		auto tagsRead = TextWithTags::Tags();
+		UI_TEST_CHECK(DeserializeTagsCompact(
+			SerializeTagsCompact(tags),
+			textLength,
+			tagsRead));
+		UI_TEST_CHECK(tagsRead == tags);
+	};
+
+	check({}, 0);
+
+	// Empty items and more overlapping items than chars in the text.
+	auto overlapping = EntitiesInText();
+	for (auto i = 0; i != 10; ++i) {
+		overlapping.push_back({ EntityType::Bold, 0, 3 });
+		overlapping.push_back({ EntityType::Italic, 1, 0 });
+	}
+	overlapping.push_back({ EntityType::Spoiler, 3, 0 });
+	check(overlapping, 3);
+
+	for (auto i = 0; i != 2000; ++i) {
+		const auto textLength = std::uniform_int_distribution<int>(
+			0,
+			300)(generator);
+		const auto count = std::uniform_int_distribution<int>(
+			0,
+			50)(generator);
+		check(RandomEntities(generator, textLength, count), textLength);
+	}
+}
+
+void TestCompactFuzz() {
+	auto generator = std::mt19937(20241016);
+	auto byte = std::uniform_int_distribution<int>(0, 255);
+	const auto check = [](const QByteArray &data, int textLength) {
+		auto entities = EntitiesInText();
+		if (DeserializeEntitiesCompact(data, textLength, entities)) {
+			for (const auto &entity : entities) {
+				UI_TEST_CHECK(entity.offset() >= 0);
+				UI_TEST_CHECK(entity.length() >= 0);
+				UI_TEST_CHECK(entity.offset() + entity.length() <= textLength);
+			}
+		} else {
+			UI_TEST_CHECK(entities.isEmpty());
+		}
+		auto tags = TextWithTags::Tags();
+		if (DeserializeTagsCompact(data, textLength, tags)) {
+			for (const auto &tag : tags) {
+				UI_TEST_CHECK(tag.offset >= 0);
+				UI_TEST_CHECK(tag.length >= 0);
+				UI_TEST_CHECK(tag.offset + tag.length <= textLength);
+			}
+		} else {
+			UI_TEST_CHECK(tags.isEmpty());
+		}
+	};
+	for (auto i = 0; i != 20000; ++i) {
+		const auto textLength = std::uniform_int_distribution<int>(
+			0,
+			100)(generator);
+		auto data = SerializeEntitiesCompact(RandomEntities(
+			generator,
+			textLength,
+			std::uniform_int_distribution<int>(1, 10)(generator)));
+		switch (i % 4) {
+		case 0: { // Random bytes after the version.
+			data.resize(1 + (byte(generator) % 32));
+			for (auto j = 1; j < data.size(); ++j) {
+				data[j] = char(byte(generator));
+			}
+		} break;
+		case 1: { // Flipped bytes.
+			for (auto j = byte(generator) % 4; j >= 0; --j) {
+				data[byte(generator) % data.size()] = char(byte(generator));
+			}
+		} break;
+		case 2: { // Truncated.
+			data.resize(byte(generator) % data.size());
+		} break;
+		case 3: { // Trailing garbage.
+			data.append(char(byte(generator)));
+		} break;
+		}
+		check(data, textLength);
+	}
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+	auto environment = Ui::Tests::Environment(argc, argv);
+	TestParseEntitiesMatchesReference();
+	TestCompactRoundTrip();
+	TestCompactFuzz();
+	return environment.finish();
+}
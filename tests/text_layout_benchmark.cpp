@@ -0,0 +1,254 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#include "tests_support.h"
+
+#include "ui/text/text.h"
+#include "ui/text/text_entity.h"
+#include "ui/painter.h"
+#include "styles/style_basic.h"
+
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<int64> Allocations = 0;
+
+[[nodiscard]] void *Allocate(std::size_t size) {
+	++Allocations;
+	if (const auto result = std::malloc(size ? size : 1)) {
+		return result;
+	}
+	throw std::bad_alloc();
+}
+
+} // namespace
+
+// Every heap allocation of the process is counted, so that allocations
+// per operation can be reported next to the timings.
+void *operator new(std::size_t size) {
+	return Allocate(size);
+}
+
+void *operator new[](std::size_t size) {
+	return Allocate(size);
+}
+
+void operator delete(void *pointer) noexcept {
+	std::free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept {
+	std::free(pointer);
+}
+
+void operator delete(void *pointer, std::size_t) noexcept {
+	std::free(pointer);
+}
+
+void operator delete[](void *pointer, std::size_t) noexcept {
+	std::free(pointer);
+}
+
+namespace {
+
+constexpr auto kIterations = 200;
+constexpr auto kWidths = std::array{ 120, 320, 640 };
+constexpr auto kStatePointsPerLine = 8;
+
+struct Sample {
+	const char *name = nullptr;
+	TextWithEntities text;
+};
+
+[[nodiscard]] QString Repeated(const QString &text, int times) {
+	auto result = QString();
+	result.reserve(text.size() * times);
+	for (auto i = 0; i != times; ++i) {
+		result.append(text);
+	}
+	return result;
+}
+
+[[nodiscard]] TextWithEntities Parse(const QString &text) {
+	return TextUtilities::ParseEntities(
+		text,
+		TextParseLinks
+			| TextParseMentions
+			| TextParseHashtags
+			| TextParseBotCommands
+			| TextParseMarkdown
+			| TextParseMultiline);
+}
+
+[[nodiscard]] TextWithEntities CustomEmojiText(int count) {
+	const auto emoji = QString::fromUtf8("\xF0\x9F\x98\x80");
+	auto result = TextWithEntities();
+	for (auto i = 0; i != count; ++i) {
+		result.entities.push_back(EntityInText(
+			EntityType::CustomEmoji,
+			result.text.size(),
+			emoji.size(),
+			QString::number(i % 16)));
+		result.text.append(emoji);
+		if (i % 8 == 7) {
+			result.text.append(u" and some text "_q);
+		}
+	}
+	return result;
+}
+
+[[nodiscard]] TextWithEntities QuoteText(int count) {
+	const auto latin = u"The quick brown fox jumps over the lazy dog. "_q;
+	auto result = TextWithEntities();
+	for (auto i = 0; i != count; ++i) {
+		result.text.append(Repeated(latin, 2) + '\n');
+		const auto offset = result.text.size();
+		result.text.append(Repeated(latin, 4));
+		result.entities.push_back(EntityInText(
+			EntityType::Blockquote,
+			offset,
+			result.text.size() - offset));
+		result.text.append('\n');
+	}
+	return result;
+}
+
+[[nodiscard]] TextWithEntities PreText(int count) {
+	const auto line = u"for (auto i = 0; i != count; ++i) { sum += i; }\n"_q;
+	auto result = TextWithEntities();
+	for (auto i = 0; i != count; ++i) {
+		result.text.append(u"Code sample:\n"_q);
+		const auto offset = result.text.size();
+		result.text.append(Repeated(line, 8));
+		result.entities.push_back(EntityInText(
+			EntityType::Pre,
+			offset,
+			result.text.size() - offset,
+			u"cpp"_q));
+		result.text.append('\n');
+	}
+	return result;
+}
+
+[[nodiscard]] std::vector<Sample> Samples() {
+	const auto latin = u"The quick brown fox jumps over the lazy dog. "_q;
+	const auto entities = u"Hi @username, see https://example.com/path?q=1 "
+		"and #hashtag with /command@bot, **bold** and __italic__. "_q;
+	const auto emoji = QString::fromUtf8(
+		"Emoji \xF0\x9F\x98\x80\xF0\x9F\x91\x8D\xF0\x9F\x8F\xBB "
+		"\xE2\x9D\xA4\xEF\xB8\x8F text \xF0\x9F\x87\xBA\xF0\x9F\x87\xA6 ");
+	const auto rtl = QString::fromUtf8(
+		"\xD9\x85\xD8\xB1\xD8\xAD\xD8\xA8\xD8\xA7 \xD8\xA8\xD8\xA7\xD9\x84"
+		"\xD8\xB9\xD8\xA7\xD9\x84\xD9\x85 mixed text ");
+	return {
+		{ "short", Parse(u"Hello, world!"_q) },
+		{ "paragraph", Parse(Repeated(latin, 20)) },
+		{ "entities", Parse(Repeated(entities, 10)) },
+		{ "emoji", Parse(Repeated(emoji, 20)) },
+		{ "custom_emoji", CustomEmojiText(160) },
+		{ "rtl", Parse(Repeated(rtl, 20)) },
+		{ "multiline", Parse(Repeated(latin + '\n', 40)) },
+		{ "quote", QuoteText(6) },
+		{ "pre", PreText(6) },
+	};
+}
+
+// Reports the average time and the average number of heap allocations
+// of a single method() call.
+template <typename Method>
+void Run(const QByteArray &name, Method &&method) {
+	Ui::Tests::Report(name, Ui::Tests::Measure(kIterations, method));
+
+	const auto was = Allocations.load();
+	for (auto i = 0; i != kIterations; ++i) {
+		method();
+	}
+	Ui::Tests::ReportAllocations(
+		name,
+		double(Allocations.load() - was) / kIterations);
+}
+
+void Run(const Sample &sample) {
+	const auto name = [&](const char *what, int width = 0) {
+		return QByteArray(sample.name)
+			+ ' '
+			+ what
+			+ (width ? ' ' + QByteArray::number(width) : QByteArray());
+	};
+	Run(name("setMarkedText"), [&] {
+		auto string = Ui::Text::String();
+		string.setMarkedText(st::defaultTextStyle, sample.text);
+	});
+
+	auto string = Ui::Text::String();
+	string.setMarkedText(st::defaultTextStyle, sample.text);
+	for (const auto width : kWidths) {
+		Run(name("countHeight", width), [&] {
+			[[maybe_unused]] const auto h = string.countHeight(width);
+		});
+	}
+	for (const auto width : kWidths) {
+		const auto height = string.countHeight(width);
+		auto image = QImage(
+			QSize(width, std::max(height, 1)),
+			QImage::Format_ARGB32_Premultiplied);
+		Run(name("draw", width), [&] {
+			image.fill(Qt::transparent);
+			auto p = Painter(&image);
+			string.draw(p, {
+				.position = QPoint(),
+				.outerWidth = width,
+				.availableWidth = width,
+			});
+		});
+	}
+	for (const auto width : kWidths) {
+		const auto height = string.countHeight(width);
+		const auto line = st::defaultTextStyle.font->height;
+		auto points = std::vector<QPoint>();
+		for (auto y = line / 2; y < height; y += line) {
+			for (auto i = 0; i != kStatePointsPerLine; ++i) {
+				points.emplace_back(i * width / kStatePointsPerLine, y);
+			}
+		}
+		if (points.empty()) {
+			continue;
+		}
+		const auto count = int(points.size());
+		const auto total = Ui::Tests::Measure(kIterations, [&] {
+			for (const auto &point : points) {
+				[[maybe_unused]] const auto state = string.getState(
+					point,
+					width);
+			}
+		});
+		Ui::Tests::Report(name("getState", width), total / count);
+	}
+	Run(name("toTextWithEntities"), [&] {
+		[[maybe_unused]] const auto text = string.toTextWithEntities();
+	});
+	const auto text = string.toTextWithEntities();
+	const auto tags = TextUtilities::ConvertEntitiesToTextTags(
+		text.entities);
+	Run(name("serializeTags"), [&] {
+		[[maybe_unused]] const auto serialized = TextUtilities::SerializeTags(
+			tags);
+	});
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+	auto environment = Ui::Tests::Environment(argc, argv);
+	for (const auto &sample : Samples()) {
+		Run(sample);
+	}
+	return environment.finish();
+}
@@ -0,0 +1,349 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#include "tests_support.h"
+
+#include "ui/text/text.h"
+#include "ui/text/text_entity.h"
+#include "base/platform/base_platform_info.h"
+
+#include <array>
+
+namespace {
+
+constexpr auto kIterations = 2000;
+
+struct Sample {
+	const char *name = nullptr;
+	QString text;
+};
+
+[[nodiscard]] QString Repeated(const QString &text, int times) {
+	auto result = QString();
+	result.reserve(text.size() * times);
+	for (auto i = 0; i != times; ++i) {
+		result.append(text);
+	}
+	return result;
+}
+
+[[nodiscard]] std::vector<Sample> Samples() {
+	const auto latin = u"The quick brown fox jumps over the lazy dog. "_q;
+	const auto cyrillic = QString::fromUtf8(
+		"\xD0\x9F\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82, "
+		"\xD0\xBC\xD0\xB8\xD1\x80! ");
+	const auto accented = QString::fromUtf8(
+		"Cr\xC3\xA8me br\xC3\xBBl\xC3\xA9e, na\xC3\xAFve "
+		"fa\xC3\xA7ade\n");
+	return {
+		{ "ascii short", u"Hello, world!"_q },
+		{ "ascii long", Repeated(latin, 100) },
+		{ "ascii multiline", Repeated(latin + '\n', 100) },
+		{ "mixed long", Repeated(latin + cyrillic, 50) },
+		{ "cyrillic long", Repeated(cyrillic, 200) },
+		{ "accented long", Repeated(accented, 100) },
+	};
+}
+
+// Copies of the per-char loops that were used before the plain ASCII
+// runs were skipped, to compare the results and the timings with.
+namespace Old {
+
+using namespace Ui::Text;
+
+[[nodiscard]] bool IsBad(QChar ch) {
+	return (ch == 0)
+		|| (ch >= 8232 && ch < 8237)
+		|| (ch >= 65024 && ch < 65040 && ch != 65039)
+		|| (ch >= 127 && ch < 160 && ch != 156)
+
+		// qt harfbuzz crash see https://github.com/telegramdesktop/tdesktop/issues/4551
+		|| (Platform::IsMac() && ch == 6158);
+}
+
+[[nodiscard]] bool IsSpace(QChar ch) {
+	return ch.isSpace()
+		|| (ch < 32)
+		|| (ch == QChar::ParagraphSeparator)
+		|| (ch == QChar::LineSeparator)
+		|| (ch == QChar::ObjectReplacementCharacter)
+		|| (ch == QChar::CarriageReturn)
+		|| (ch == QChar::Tabulation);
+}
+
+[[nodiscard]] bool IsTrimmed(QChar ch) {
+	return IsSpace(ch)
+		|| IsBad(ch)
+		|| (ch == QChar(8203)); // zero width space
+}
+
+// The accent table is internal to text_entity.cpp, so the folded chars
+// are looked up in a table filled from the current RemoveAccents().
+// A lookup is not slower than the original switch, so the timings of
+// the old loop are not understated.
+[[nodiscard]] const std::vector<QChar> &AccentsTable() {
+	static const auto result = [] {
+		auto result = std::vector<QChar>(0x10000);
+		for (auto i = 0; i != 0x10000; ++i) {
+			const auto ch = QChar(ushort(i));
+			const auto folded = ch.isSurrogate()
+				? QString()
+				: TextUtilities::RemoveAccents(QString(ch));
+			result[i] = (folded.size() == 1) ? folded[0] : ch;
+		}
+		return result;
+	}();
+	return result;
+}
+
+[[nodiscard]] QChar RemoveOneAccent(const QChar *ch, bool pair) {
+	if (!pair) {
+		return AccentsTable()[ch->unicode()];
+	}
+	const auto folded = TextUtilities::RemoveAccents(QString(ch, 2));
+	return (folded.size() == 1) ? folded[0] : QChar();
+}
+
+[[nodiscard]] QString RemoveAccents(const QString &text) {
+	auto result = text;
+	auto copying = false;
+	auto i = 0;
+	for (auto s = text.unicode(), ch = s, e = text.unicode() + text.size(); ch != e; ++ch, ++i) {
+		if (ch->unicode() < 128) {
+			if (copying) result[i] = *ch;
+			continue;
+		}
+		if (IsDiacritic(*ch)) {
+			copying = true;
+			--i;
+			continue;
+		}
+		if (ch->isHighSurrogate() && ch + 1 < e && (ch + 1)->isLowSurrogate()) {
+			auto noAccent = RemoveOneAccent(ch, true);
+			if (noAccent.unicode() > 0) {
+				copying = true;
+				result[i] = noAccent;
+			} else {
+				if (copying) result[i] = *ch;
+				++ch, ++i;
+				if (copying) result[i] = *ch;
+			}
+		} else {
+			auto noAccent = RemoveOneAccent(ch, false);
+			if (noAccent.unicode() > 0 && noAccent != *ch) {
+				result[i] = noAccent;
+			} else if (copying) {
+				result[i] = *ch;
+			}
+		}
+	}
+	return (i < result.size()) ? result.mid(0, i) : result;
+}
+
+[[nodiscard]] QString SingleLine(const QString &text) {
+	auto result = text;
+	auto s = text.unicode(), e = text.unicode() + text.size();
+
+	// Trim.
+	while (s < e && IsTrimmed(*s)) {
+		++s;
+	}
+	while (s < e && IsTrimmed(*(e - 1))) {
+		--e;
+	}
+	if (e - s != text.size()) {
+		result = text.mid(s - text.unicode(), e - s);
+	}
+
+	for (auto ch = s; ch != e; ++ch) {
+		if (IsNewline(*ch)/* || *ch == TextCommand*/) {
+			result[int(ch - s)] = QChar::Space;
+		}
+	}
+	return result;
+}
+
+void Trim(TextWithEntities &result) {
+	auto foundNotTrimmedChar = false;
+
+	// right trim
+	for (auto s = result.text.data(), e = s + result.text.size(), ch = e; ch != s;) {
+		--ch;
+		if (!IsTrimmed(*ch)) {
+			if (ch + 1 < e) {
+				auto l = ch + 1 - s;
+				for (auto &entity : result.entities) {
+					entity.updateTextEnd(l);
+				}
+				result.text.resize(l);
+			}
+			foundNotTrimmedChar = true;
+			break;
+		}
+	}
+	if (!foundNotTrimmedChar) {
+		result = TextWithEntities();
+		return;
+	}
+
+	const auto firstMonospaceOffset = EntityInText::FirstMonospaceOffset(
+		result.entities,
+		result.text.size());
+
+	// left trim
+	for (auto s = result.text.data(), ch = s, e = s + result.text.size(); ch != e; ++ch) {
+		if (!IsTrimmed(*ch) || (ch - s) == firstMonospaceOffset) {
+			if (ch > s) {
+				auto l = ch - s;
+				for (auto &entity : result.entities) {
+					entity.shiftLeft(l);
+				}
+				result.text = result.text.mid(l);
+			}
+			break;
+		}
+	}
+}
+
+} // namespace Old
+
+// Reports the old and the new timings of the same operation.
+template <typename OldMethod, typename NewMethod>
+void Compare(
+		const QByteArray &name,
+		OldMethod &&oldMethod,
+		NewMethod &&newMethod) {
+	Ui::Tests::Report(
+		name + " old",
+		Ui::Tests::Measure(kIterations, oldMethod));
+	Ui::Tests::Report(
+		name + " new",
+		Ui::Tests::Measure(kIterations, newMethod));
+}
+
+template <typename Check>
+[[nodiscard]] int CountChars(const QString &text, Check &&check) {
+	auto result = 0;
+	for (const auto ch : text) {
+		if (check(ch)) {
+			++result;
+		}
+	}
+	return result;
+}
+
+void Run(const Sample &sample) {
+	const auto name = [&](const char *what) {
+		return QByteArray(sample.name) + ' ' + what;
+	};
+	const auto &text = sample.text;
+	const auto padded = TextWithEntities{ u"  "_q + text + u"  "_q };
+	const auto oldTrim = [&] {
+		auto result = padded;
+		Old::Trim(result);
+		return result;
+	};
+	const auto newTrim = [&] {
+		auto result = padded;
+		TextUtilities::Trim(result);
+		return result;
+	};
+
+	UI_TEST_CHECK(Old::RemoveAccents(text)
+		== TextUtilities::RemoveAccents(text));
+	UI_TEST_CHECK(Old::SingleLine(text) == TextUtilities::SingleLine(text));
+	UI_TEST_CHECK(oldTrim().text == newTrim().text);
+
+	Compare(name("RemoveAccents"), [&] {
+		[[maybe_unused]] const auto result = Old::RemoveAccents(text);
+	}, [&] {
+		[[maybe_unused]] const auto result = TextUtilities::RemoveAccents(
+			text);
+	});
+	Compare(name("SingleLine"), [&] {
+		[[maybe_unused]] const auto result = Old::SingleLine(text);
+	}, [&] {
+		[[maybe_unused]] const auto result = TextUtilities::SingleLine(
+			text);
+	});
+	Compare(name("Trim"), oldTrim, newTrim);
+
+	Compare(name("IsBad"), [&] {
+		[[maybe_unused]] const auto result = CountChars(text, Old::IsBad);
+	}, [&] {
+		[[maybe_unused]] const auto result = CountChars(
+			text,
+			Ui::Text::IsBad);
+	});
+	Compare(name("IsSpace"), [&] {
+		[[maybe_unused]] const auto result = CountChars(text, Old::IsSpace);
+	}, [&] {
+		[[maybe_unused]] const auto result = CountChars(
+			text,
+			Ui::Text::IsSpace);
+	});
+}
+
+void CheckCharClasses() {
+	for (auto i = 0; i != 0x10000; ++i) {
+		const auto ch = QChar(ushort(i));
+		UI_TEST_CHECK(Old::IsBad(ch) == Ui::Text::IsBad(ch));
+		UI_TEST_CHECK(Old::IsSpace(ch) == Ui::Text::IsSpace(ch));
+	}
+}
+
+[[nodiscard]] TextWithTags::Tags SampleTags(int count) {
+	const auto ids = std::array{
+		u"**"_q,
+		u"__"_q,
+		u"mention://user.1234567.987654321:42"_q,
+		u"http://example.com/page"_q,
+	};
+	auto result = TextWithTags::Tags();
+	for (auto i = 0; i != count; ++i) {
+		result.push_back({ i * 7, 5 + (i % 11), ids[i % ids.size()] });
+	}
+	return result;
+}
+
+void RunTags(int count) {
+	const auto name = [&](const char *what) {
+		return "tags " + QByteArray::number(count) + ' ' + what;
+	};
+	const auto tags = SampleTags(count);
+	const auto textLength = count * 7 + 16;
+	const auto legacy = TextUtilities::SerializeTags(tags);
+	const auto compact = TextUtilities::SerializeTagsCompact(tags);
+	Ui::Tests::ReportSize(name("legacy size"), legacy.size());
+	Ui::Tests::ReportSize(name("compact size"), compact.size());
+	Ui::Tests::Report(name("legacy write"), Ui::Tests::Measure(
+		kIterations,
+		[&] { [[maybe_unused]] const auto result = TextUtilities::SerializeTags(tags); }));
+	Ui::Tests::Report(name("compact write"), Ui::Tests::Measure(
+		kIterations,
+		[&] { [[maybe_unused]] const auto result = TextUtilities::SerializeTagsCompact(tags); }));
+	Ui::Tests::Report(name("legacy read"), Ui::Tests::Measure(
+		kIterations,
+		[&] { [[maybe_unused]] const auto result = TextUtilities::DeserializeTags(legacy, textLength); }));
+	auto read = TextWithTags::Tags();
+	Ui::Tests::Report(name("compact read"), Ui::Tests::Measure(
+		kIterations,
+		[&] { [[maybe_unused]] const auto ok = TextUtilities::DeserializeTagsCompact(compact, textLength, read); }));
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+	auto environment = Ui::Tests::Environment(argc, argv);
+	CheckCharClasses();
+	for (const auto &sample : Samples()) {
+		Run(sample);
+	}
+	for (const auto count : { 1, 10, 100 }) {
+		RunTags(count);
+	}
+	return environment.finish();
+}
@@ -270,8 +270,17 @@ QImage RippleAnimation::RectMask(QSize size) {
 }
 
 QImage RippleAnimation::RoundRectMask(QSize size, int radius) {
-	return MaskByDrawer(size, false, [&](QPainter &p) {
-		p.drawRoundedRect(0, 0, size.width(), size.height(), radius, radius);
+	const auto key = Images::CachedMaskKey{
+		.type = Images::CachedMaskType::RippleRoundRect,
+		.width = size.width(),
+		.height = size.height(),
+		.radius = radius,
+		.ratio = double(style::DevicePixelRatio()),
+	};
+	return Images::CachedMask(key, [&] {
+		return MaskByDrawer(size, false, [&](QPainter &p) {
+			p.drawRoundedRect(0, 0, size.width(), size.height(), radius, radius);
+		});
 	});
 }
 
@@ -304,8 +313,16 @@ QImage RippleAnimation::RoundRectMask(
 }
 
 QImage RippleAnimation::EllipseMask(QSize size) {
-	return MaskByDrawer(size, false, [&](QPainter &p) {
-		p.drawEllipse(0, 0, size.width(), size.height());
+	const auto key = Images::CachedMaskKey{
+		.type = Images::CachedMaskType::RippleEllipse,
+		.width = size.width(),
+		.height = size.height(),
+		.ratio = double(style::DevicePixelRatio()),
+	};
+	return Images::CachedMask(key, [&] {
+		return MaskByDrawer(size, false, [&](QPainter &p) {
+			p.drawEllipse(0, 0, size.width(), size.height());
+		});
 	});
 }
 
@@ -86,6 +86,10 @@ auto TouchbarInstance = std::unique_ptr<Instance>();
 auto TouchbarEmoji = (Instance*)nullptr;
 #endif
 
+// Bit for each UTF-16 code unit that some emoji text starts with.
+auto FirstCodeUnits = std::array<uint64, 0x10000 / 64>();
+auto FirstCodeUnitsReady = false;
+
 auto MainEmojiMap = std::map<int, QPixmap>();
 auto OtherEmojiMap = base::flat_map<int, std::map<int, QPixmap>>();
 
@@ -391,6 +395,26 @@ void ClearUniversalChecked() {
 	}
 }
 
+void MarkFirstCodeUnit(const QString &text) {
+	if (!text.isEmpty()) {
+		const auto code = text[0].unicode();
+		FirstCodeUnits[code >> 6] |= (uint64(1) << (code & 63));
+	}
+}
+
+void FillFirstCodeUnits() {
+	// internal::Find() matches the texts with and without the postfix,
+	// as well as the ones with all the variation selectors dropped.
+	for (auto i = 0, count = internal::FullCount(); i != count; ++i) {
+		const auto emoji = internal::ByIndex(i);
+		const auto text = emoji->text();
+		MarkFirstCodeUnit(emoji->id());
+		MarkFirstCodeUnit(text);
+		MarkFirstCodeUnit(QString(text).remove(QChar(kPostfix)));
+	}
+	FirstCodeUnitsReady = true;
+}
+
 } // namespace
 
 namespace internal {
@@ -399,6 +423,12 @@ QString CacheFileFolder() {
 	return Integration::Instance().emojiCacheFolder();
 }
 
+bool MayStartEmoji(QChar ch) {
+	const auto code = ch.unicode();
+	return !FirstCodeUnitsReady
+		|| (FirstCodeUnits[code >> 6] & (uint64(1) << (code & 63)));
+}
+
 QString SetDataPath(int id) {
 	Expects(IsValidSetId(id) && id != 0);
 
@@ -502,6 +532,7 @@ QImage UniversalImages::generate(int size, int index) const {
 
 void Init() {
 	internal::Init();
+	FillFirstCodeUnits();
 
 	const auto count = internal::FullCount();
 	const auto persprite = kImagesPerRow * kImageRowsPerSprite;
@@ -527,6 +558,26 @@ void Init() {
 #endif
 }
 
+std::vector<FoundEmoji> FindAll(QStringView text) {
+	auto result = std::vector<FoundEmoji>();
+	const auto start = text.data();
+	const auto end = start + text.size();
+	for (auto ch = start; ch != end;) {
+		auto length = 0;
+		if (const auto emoji = Find(ch, end, &length)) {
+			result.push_back({
+				.emoji = emoji,
+				.offset = int(ch - start),
+				.length = length,
+			});
+			ch += length;
+		} else {
+			++ch;
+		}
+	}
+	return result;
+}
+
 void Clear() {
 	MainEmojiMap.clear();
 	OtherEmojiMap.clear();
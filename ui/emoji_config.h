@@ -23,6 +23,9 @@ namespace internal {
 [[nodiscard]] QString CacheFileFolder();
 [[nodiscard]] QString SetDataPath(int id);
 
+// Checks a flat table of code units that emoji can start with.
+[[nodiscard]] bool MayStartEmoji(QChar ch);
+
 } // namespace internal
 
 void Init();
@@ -128,14 +131,25 @@ private:
 	return nullptr;
 }
 
+// Find() and FindAll() read only data that is immutable after Init(),
+// so they may be used from any thread after that.
 [[nodiscard]] inline EmojiPtr Find(const QChar *start, const QChar *end, int *outLength = nullptr) {
-	return internal::Find(start, end, outLength);
+	return (start != end && internal::MayStartEmoji(*start))
+		? internal::Find(start, end, outLength)
+		: nullptr;
 }
 
 [[nodiscard]] inline EmojiPtr Find(const QString &text, int *outLength = nullptr) {
 	return Find(text.constBegin(), text.constEnd(), outLength);
 }
 
+struct FoundEmoji {
+	EmojiPtr emoji = nullptr;
+	int offset = 0;
+	int length = 0;
+};
+[[nodiscard]] std::vector<FoundEmoji> FindAll(QStringView text);
+
 [[nodiscard]] QString IdFromOldKey(uint64 oldKey);
 
 [[nodiscard]] inline EmojiPtr FromOldKey(uint64 oldKey) {
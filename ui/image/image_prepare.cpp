@@ -19,17 +19,40 @@
 #include <QtCore/QFile>
 #include <QtCore/QBuffer>
 #include <QtCore/QMutex>
+#include <QtCore/QThread>
+#include <QtCore/qsimd.h>
 #include <QtGui/QImageReader>
 #include <QtSvg/QSvgRenderer>
+#include <crl/crl_async.h>
+#include <crl/crl_semaphore.h>
+
+#include <atomic>
 
 #include <jpeglib.h>
 
+#if defined __SSE2__ && !defined LIB_UI_NO_SIMD_IMAGES
+#include <emmintrin.h>
+#elif defined __ARM_NEON && !defined LIB_UI_NO_SIMD_IMAGES
+#include <arm_neon.h>
+#endif // __SSE2__ || __ARM_NEON
+
 namespace Images {
 namespace {
 
 // They should be smaller.
 constexpr auto kMaxGzipFileSize = 5 * 1024 * 1024;
 
+constexpr auto kPrepareBlack = uint32(0xFF000000U);
+
+constexpr auto kCachedMasksLimit = int64(8 * 1024 * 1024);
+
+constexpr auto kBlurParallelMinArea = 256 * 256;
+constexpr auto kBlurMinPartSize = 32;
+constexpr auto kBlurMaxThreads = 8;
+constexpr auto kBlurFastMinRadius = 8;
+constexpr auto kBlurFastMinSide = 16;
+constexpr auto kBlurFastMaxLevel = 4;
+
 TG_FORCE_INLINE uint64 BlurGetColors(const uchar *p) {
 	return (uint64)p[0]
 		+ ((uint64)p[1] << 16)
@@ -37,23 +60,173 @@ TG_FORCE_INLINE uint64 BlurGetColors(const uchar *p) {
 		+ ((uint64)p[3] << 48);
 }
 
-const QImage &EllipseMaskCached(QSize size) {
-	const auto key = (uint64(uint32(size.width())) << 32)
-		| uint64(uint32(size.height()));
+[[nodiscard]] QImage GenerateEllipseMask(QSize size, double ratio) {
+	size *= ratio;
+	auto result = QImage(size, QImage::Format_ARGB32_Premultiplied);
+	result.fill(Qt::transparent);
 
-	static auto Masks = base::flat_map<uint64, QImage>();
-	static auto Mutex = QMutex();
-	auto lock = QMutexLocker(&Mutex);
-	const auto i = Masks.find(key);
-	if (i != end(Masks)) {
+	QPainter p(&result);
+	PainterHighQualityEnabler hq(p);
+	p.setBrush(Qt::white);
+	p.setPen(Qt::NoPen);
+	p.drawEllipse(QRect(QPoint(), size));
+	p.end();
+
+	result.setDevicePixelRatio(ratio);
+	return result;
+}
+
+// Only the antialiased edges of an ellipse mask are stored, for each row
+// the pixels before the first and after the last fully opaque one.
+struct EllipseEdges {
+	std::vector<int> offsets;
+	std::vector<int> lefts;
+	std::vector<int> rights;
+	std::vector<uchar> values;
+};
+
+[[nodiscard]] EllipseEdges PrepareEllipseEdges(QSize size) {
+	const auto mask = GenerateEllipseMask(size, 1.);
+	const auto width = mask.width();
+	const auto height = mask.height();
+	const auto perLine = mask.bytesPerLine() / sizeof(uint32);
+	auto result = EllipseEdges();
+	result.offsets.reserve(height);
+	result.lefts.reserve(height);
+	result.rights.reserve(height);
+	auto line = reinterpret_cast<const uint32*>(mask.constBits());
+	const auto alpha = [&](int x) {
+		return uchar(line[x] >> 24);
+	};
+	for (auto y = 0; y != height; ++y, line += perLine) {
+		auto left = 0;
+		while (left != width && alpha(left) != 0xFF) {
+			++left;
+		}
+		auto right = 0;
+		while (left + right != width && alpha(width - right - 1) != 0xFF) {
+			++right;
+		}
+		result.offsets.push_back(int(result.values.size()));
+		result.lefts.push_back(left);
+		result.rights.push_back(right);
+		for (auto x = 0; x != left; ++x) {
+			result.values.push_back(alpha(x));
+		}
+		for (auto x = width - right; x != width; ++x) {
+			result.values.push_back(alpha(x));
+		}
+	}
+	return result;
+}
+
+// The raster QPainter DestinationIn arithmetic, x * alpha / 255 rounded,
+// so that Circle gives the result of painting the full ellipse mask.
+[[nodiscard]] TG_FORCE_INLINE uint32 MultiplyByAlphaRounded(
+		uint32 x,
+		uint32 alpha) {
+	auto t = (x & 0x00FF00FFU) * alpha;
+	t = ((t + ((t >> 8) & 0x00FF00FFU) + 0x00800080U) >> 8) & 0x00FF00FFU;
+	x = ((x >> 8) & 0x00FF00FFU) * alpha;
+	x = (x + ((x >> 8) & 0x00FF00FFU) + 0x00800080U) & 0xFF00FF00U;
+	return x | t;
+}
+
+// Entries hold either the mask images or the ellipse edges.
+struct CachedMasksEntry {
+	std::array<QImage, 4> images;
+	std::shared_ptr<const EllipseEdges> edges;
+	int64 bytes = 0;
+	uint64 used = 0;
+};
+
+struct CachedMasks {
+	base::flat_map<CachedMaskKey, CachedMasksEntry> entries;
+	CachedMasksStats stats;
+	uint64 counter = 0;
+	QMutex mutex;
+};
+
+[[nodiscard]] CachedMasks &CachedMasksInstance() {
+	static auto result = CachedMasks();
+	return result;
+}
+
+[[nodiscard]] int64 CachedMasksEntryBytes(const CachedMasksEntry &entry) {
+	auto result = int64();
+	for (const auto &image : entry.images) {
+		result += image.sizeInBytes();
+	}
+	if (const auto edges = entry.edges.get()) {
+		result += int64(edges->offsets.size()
+			+ edges->lefts.size()
+			+ edges->rights.size()) * sizeof(int)
+			+ int64(edges->values.size());
+	}
+	return result;
+}
+
+template <typename Generator>
+[[nodiscard]] CachedMasksEntry CachedMasksEntryFor(
+		const CachedMaskKey &key,
+		Generator &&generate) {
+	auto &cache = CachedMasksInstance();
+	auto lock = QMutexLocker(&cache.mutex);
+	const auto i = cache.entries.find(key);
+	if (i != end(cache.entries)) {
+		++cache.stats.hits;
+		i->second.used = ++cache.counter;
 		return i->second;
 	}
+	++cache.stats.misses;
 	lock.unlock();
 
-	auto mask = EllipseMask(size, 1.);
+	auto entry = generate();
+	entry.bytes = CachedMasksEntryBytes(entry);
 
 	lock.relock();
-	return Masks.emplace(key, std::move(mask)).first->second;
+	const auto [j, inserted] = cache.entries.emplace(key, entry);
+	j->second.used = ++cache.counter;
+	if (inserted) {
+		cache.stats.bytes += entry.bytes;
+	}
+	while (cache.stats.bytes > kCachedMasksLimit
+		&& cache.entries.size() > 1) {
+		const auto oldest = ranges::min_element(
+			cache.entries,
+			ranges::less(),
+			[](const auto &pair) { return pair.second.used; });
+		cache.stats.bytes -= oldest->second.bytes;
+		cache.entries.erase(oldest);
+	}
+	cache.stats.count = int(cache.entries.size());
+	return entry;
+}
+
+template <typename Generator>
+[[nodiscard]] std::array<QImage, 4> CachedMasksFor(
+		const CachedMaskKey &key,
+		Generator &&generate) {
+	return CachedMasksEntryFor(key, [&] {
+		return CachedMasksEntry{ .images = generate() };
+	}).images;
+}
+
+// The edges are shared, so they stay valid for the caller
+// even if the entry is dropped from the cache meanwhile.
+[[nodiscard]] std::shared_ptr<const EllipseEdges> EllipseEdgesCached(
+		QSize size) {
+	const auto key = CachedMaskKey{
+		.type = CachedMaskType::EllipseEdges,
+		.width = size.width(),
+		.height = size.height(),
+	};
+	return CachedMasksEntryFor(key, [&] {
+		return CachedMasksEntry{
+			.edges = std::make_shared<EllipseEdges>(
+				PrepareEllipseEdges(size)),
+		};
+	}).edges;
 }
 
 std::array<QImage, 4> PrepareCornersMask(int radius) {
@@ -288,6 +461,316 @@ template <int kBits> // 4 means 16x16, 3 means 8x8
 			Qt::SmoothTransformation);
 }
 
+[[nodiscard]] QImage TakePrepareStorage(QImage *storage, QSize size) {
+	if (storage
+		&& storage->size() == size
+		&& storage->format() == QImage::Format_ARGB32_Premultiplied
+		&& storage->isDetached()) {
+		return base::take(*storage);
+	}
+	return QImage(size, QImage::Format_ARGB32_Premultiplied);
+}
+
+// Writes the image at the position in a single pass over the result,
+// filling only the parts not covered by it with the background.
+// Drawing premultiplied pixels over opaque black only forces the alpha.
+void ComposeCentered(
+		QImage &result,
+		QImage image,
+		QPoint position,
+		uint32 background,
+		bool opaqueBackground) {
+	Expects(result.format() == QImage::Format_ARGB32_Premultiplied);
+
+	if (image.format() != QImage::Format_RGB32
+		&& image.format() != QImage::Format_ARGB32_Premultiplied) {
+		image = std::move(image).convertToFormat(
+			QImage::Format_ARGB32_Premultiplied);
+	}
+	const auto width = result.width();
+	const auto height = result.height();
+	const auto inner = QRect(position, image.size()).intersected(
+		QRect(0, 0, width, height));
+	const auto left = inner.x();
+	const auto right = left + inner.width();
+	const auto top = inner.y();
+	const auto bottom = top + inner.height();
+	const auto forceAlpha = opaqueBackground && image.hasAlphaChannel();
+	const auto perLine = result.bytesPerLine() / sizeof(uint32);
+	const auto imagePerLine = image.bytesPerLine() / sizeof(uint32);
+	const auto source = reinterpret_cast<const uint32*>(image.constBits());
+	auto ints = reinterpret_cast<uint32*>(result.bits());
+	for (auto y = 0; y != height; ++y, ints += perLine) {
+		if (y < top || y >= bottom) {
+			std::fill_n(ints, width, background);
+			continue;
+		}
+		std::fill_n(ints, left, background);
+		const auto from = source
+			+ (y - position.y()) * imagePerLine
+			+ (left - position.x());
+		if (forceAlpha) {
+			for (auto x = left; x != right; ++x) {
+				ints[x] = from[x - left] | kPrepareBlack;
+			}
+		} else {
+			memcpy(ints + left, from, inner.width() * sizeof(uint32));
+		}
+		std::fill_n(ints + right, width - right, background);
+	}
+}
+
+// Large blurs are split by rows and then by columns between the calling
+// thread and crl::async workers. The caller takes parts itself as well,
+// so it waits only for the parts that workers have already started.
+template <typename Method>
+void RunBlurParts(int count, bool parallel, Method &&method) {
+	const auto threads = parallel
+		? std::clamp(QThread::idealThreadCount(), 1, kBlurMaxThreads)
+		: 1;
+	const auto parts = std::min(threads, count / kBlurMinPartSize);
+	if (parts <= 1) {
+		method(0, count);
+		return;
+	}
+	struct State {
+		std::atomic<int> next = 0;
+		std::atomic<int> finished = 0;
+		crl::semaphore done;
+	};
+	const auto state = std::make_shared<State>();
+
+	// The method lives on the caller stack, so it is used only after
+	// a part was taken, the caller waits for all taken parts to finish.
+	const auto run = [=](State &shared, auto *method) {
+		auto last = false;
+		while (true) {
+			const auto index = shared.next.fetch_add(1);
+			if (index >= parts) {
+				return last;
+			}
+			(*method)(
+				int(int64(count) * index / parts),
+				int(int64(count) * (index + 1) / parts));
+			last = (shared.finished.fetch_add(1) + 1 == parts);
+		}
+	};
+	const auto raw = &method;
+	for (auto i = 1; i != parts; ++i) {
+		crl::async([=] {
+			if (run(*state, raw)) {
+				state->done.release();
+			}
+		});
+	}
+	if (!run(*state, raw)) {
+		state->done.acquire();
+	}
+}
+
+// Stack blur sums of the four channels of a pixel, in one vector where
+// the vector unit is always available. Channels are at most 255 and the
+// weights are at most radius + 1, so the products fit 16 bit halves.
+// LIB_UI_NO_SIMD_IMAGES builds the plain versions, to check them.
+#if defined __SSE2__ && !defined LIB_UI_NO_SIMD_IMAGES
+using BlurSums = __m128i;
+
+TG_FORCE_INLINE BlurSums BlurZero() {
+	return _mm_setzero_si128();
+}
+
+TG_FORCE_INLINE BlurSums BlurLoad(const uchar *pixel) {
+	auto value = int32();
+	memcpy(&value, pixel, sizeof(value));
+	const auto zero = _mm_setzero_si128();
+	return _mm_unpacklo_epi16(
+		_mm_unpacklo_epi8(_mm_cvtsi32_si128(value), zero),
+		zero);
+}
+
+TG_FORCE_INLINE BlurSums BlurAdd(BlurSums a, BlurSums b) {
+	return _mm_add_epi32(a, b);
+}
+
+TG_FORCE_INLINE BlurSums BlurSubtract(BlurSums a, BlurSums b) {
+	return _mm_sub_epi32(a, b);
+}
+
+TG_FORCE_INLINE BlurSums BlurMultiply(BlurSums a, int weight) {
+	return _mm_madd_epi16(a, _mm_set1_epi32(weight));
+}
+
+TG_FORCE_INLINE void BlurStore(BlurSums a, int32 *to) {
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(to), a);
+}
+#elif defined __ARM_NEON && !defined LIB_UI_NO_SIMD_IMAGES
+using BlurSums = int32x4_t;
+
+TG_FORCE_INLINE BlurSums BlurZero() {
+	return vdupq_n_s32(0);
+}
+
+TG_FORCE_INLINE BlurSums BlurLoad(const uchar *pixel) {
+	auto value = uint32();
+	memcpy(&value, pixel, sizeof(value));
+	return vreinterpretq_s32_u32(
+		vmovl_u16(vget_low_u16(vmovl_u8(vcreate_u8(value)))));
+}
+
+TG_FORCE_INLINE BlurSums BlurAdd(BlurSums a, BlurSums b) {
+	return vaddq_s32(a, b);
+}
+
+TG_FORCE_INLINE BlurSums BlurSubtract(BlurSums a, BlurSums b) {
+	return vsubq_s32(a, b);
+}
+
+TG_FORCE_INLINE BlurSums BlurMultiply(BlurSums a, int weight) {
+	return vmulq_n_s32(a, weight);
+}
+
+TG_FORCE_INLINE void BlurStore(BlurSums a, int32 *to) {
+	vst1q_s32(to, a);
+}
+#else // __SSE2__ || __ARM_NEON
+struct BlurSums {
+	int32 values[4] = { 0 };
+};
+
+TG_FORCE_INLINE BlurSums BlurZero() {
+	return BlurSums();
+}
+
+TG_FORCE_INLINE BlurSums BlurLoad(const uchar *pixel) {
+	return { { pixel[0], pixel[1], pixel[2], pixel[3] } };
+}
+
+TG_FORCE_INLINE BlurSums BlurAdd(BlurSums a, BlurSums b) {
+	for (auto i = 0; i != 4; ++i) {
+		a.values[i] += b.values[i];
+	}
+	return a;
+}
+
+TG_FORCE_INLINE BlurSums BlurSubtract(BlurSums a, BlurSums b) {
+	for (auto i = 0; i != 4; ++i) {
+		a.values[i] -= b.values[i];
+	}
+	return a;
+}
+
+TG_FORCE_INLINE BlurSums BlurMultiply(BlurSums a, int weight) {
+	for (auto i = 0; i != 4; ++i) {
+		a.values[i] *= weight;
+	}
+	return a;
+}
+
+TG_FORCE_INLINE void BlurStore(BlurSums a, int32 *to) {
+	memcpy(to, a.values, sizeof(a.values));
+}
+#endif // __SSE2__ || __ARM_NEON
+
+// Wrapped to keep the vector type attributes in std::vector.
+struct BlurStackEntry {
+	BlurSums sums;
+};
+
+// Four pixels per step where the vector unit is always available.
+// Sums are kept in 32 bit lanes and truncated like the scalar loop.
+void ColorLine(uchar *pix, int width, QColor add) {
+	const auto ca = add.alpha();
+	const auto cr = add.red() * (ca + 1);
+	const auto cg = add.green() * (ca + 1);
+	const auto cb = add.blue() * (ca + 1);
+	const auto ra = (0x100 - ca) * 0x100;
+	auto x = 0;
+#if defined __SSE2__ && !defined LIB_UI_NO_SIMD_IMAGES
+	const auto zero = _mm_setzero_si128();
+	const auto one = _mm_set1_epi16(1);
+	const auto byte = _mm_set1_epi32(0xFF);
+	const auto alpha = _mm_set1_epi32(int(0xFF000000U));
+	const auto inverted = _mm_set1_epi16(short(0x100 - ca));
+	const auto colors = _mm_set_epi16(
+		0, short(cr), short(cg), short(cb),
+		0, short(cr), short(cg), short(cb));
+	const auto half = [&](__m128i components) {
+		const auto a = _mm_add_epi16(
+			_mm_shufflehi_epi16(
+				_mm_shufflelo_epi16(components, _MM_SHUFFLE(3, 3, 3, 3)),
+				_MM_SHUFFLE(3, 3, 3, 3)),
+			one);
+		const auto kept = _mm_mullo_epi16(components, inverted);
+		const auto addedLow = _mm_mullo_epi16(a, colors);
+		const auto addedHigh = _mm_mulhi_epu16(a, colors);
+		const auto sum = [&](__m128i kept, __m128i added) {
+			return _mm_and_si128(
+				_mm_srli_epi32(
+					_mm_add_epi32(_mm_slli_epi32(kept, 8), added),
+					16),
+				byte);
+		};
+		return _mm_packs_epi32(
+			sum(
+				_mm_unpacklo_epi16(kept, zero),
+				_mm_unpacklo_epi16(addedLow, addedHigh)),
+			sum(
+				_mm_unpackhi_epi16(kept, zero),
+				_mm_unpackhi_epi16(addedLow, addedHigh)));
+	};
+	for (; x + 4 <= width; x += 4) {
+		const auto to = reinterpret_cast<__m128i*>(pix + x * 4);
+		const auto source = _mm_loadu_si128(to);
+		const auto result = _mm_packus_epi16(
+			half(_mm_unpacklo_epi8(source, zero)),
+			half(_mm_unpackhi_epi8(source, zero)));
+		_mm_storeu_si128(
+			to,
+			_mm_or_si128(
+				_mm_andnot_si128(alpha, result),
+				_mm_and_si128(alpha, source)));
+	}
+#elif defined __ARM_NEON && !defined LIB_UI_NO_SIMD_IMAGES
+	const uint32 values[4] = { uint32(cb), uint32(cg), uint32(cr), 0 };
+	const auto colors = vld1q_u32(values);
+	const auto alpha = vreinterpretq_u8_u32(vdupq_n_u32(0xFF000000U));
+	const auto pixel = [&](uint16x4_t components) {
+		const auto wide = vmovl_u16(components);
+		const auto a = vaddq_u32(
+			vdupq_lane_u32(vget_high_u32(wide), 1),
+			vdupq_n_u32(1));
+		return vmovn_u32(vandq_u32(
+			vshrq_n_u32(
+				vmlaq_u32(
+					vmulq_n_u32(wide, uint32(ra)),
+					a,
+					colors),
+				16),
+			vdupq_n_u32(0xFF)));
+	};
+	const auto half = [&](uint8x8_t bytes) {
+		const auto components = vmovl_u8(bytes);
+		return vmovn_u16(vcombine_u16(
+			pixel(vget_low_u16(components)),
+			pixel(vget_high_u16(components))));
+	};
+	for (; x + 4 <= width; x += 4) {
+		const auto to = pix + x * 4;
+		const auto source = vld1q_u8(to);
+		const auto result = vcombine_u8(
+			half(vget_low_u8(source)),
+			half(vget_high_u8(source)));
+		vst1q_u8(to, vbslq_u8(alpha, source, result));
+	}
+#endif // __SSE2__ || __ARM_NEON
+	for (auto i = x * 4, to = width * 4; i != to; i += 4) {
+		const auto a = pix[i + 3] + 1;
+		pix[i + 0] = (ra * pix[i + 0] + a * cb) >> 16;
+		pix[i + 1] = (ra * pix[i + 1] + a * cg) >> 16;
+		pix[i + 2] = (ra * pix[i + 2] + a * cr) >> 16;
+	}
+}
+
 } // namespace
 
 QPixmap PixmapFast(QImage &&image) {
@@ -310,41 +793,64 @@ const std::array<QImage, 4> &CornersMask(ImageRoundRadius radius) {
 std::array<QImage, 4> PrepareCorners(
 		ImageRoundRadius radius,
 		const style::color &color) {
-	auto result = CornersMask(radius);
-	for (auto &image : result) {
-		style::colorizeImage(image, color->c, &image);
-	}
-	return result;
+	return PrepareCorners(
+		((radius == ImageRoundRadius::Large)
+			? st::roundRadiusLarge
+			: st::roundRadiusSmall),
+		color);
 }
 
 std::array<QImage, 4> CornersMask(int radius) {
-	return PrepareCornersMask(radius);
+	const auto key = CachedMaskKey{
+		.type = CachedMaskType::Corners,
+		.radius = radius,
+		.ratio = double(style::DevicePixelRatio()),
+	};
+	return CachedMasksFor(key, [&] {
+		return PrepareCornersMask(radius);
+	});
 }
 
-QImage EllipseMask(QSize size, double ratio) {
-	size *= ratio;
-	auto result = QImage(size, QImage::Format_ARGB32_Premultiplied);
-	result.fill(Qt::transparent);
+QImage CachedMask(const CachedMaskKey &key, Fn<QImage()> generate) {
+	return CachedMasksFor(key, [&] {
+		return std::array<QImage, 4>{ generate() };
+	})[0];
+}
 
-	QPainter p(&result);
-	PainterHighQualityEnabler hq(p);
-	p.setBrush(Qt::white);
-	p.setPen(Qt::NoPen);
-	p.drawEllipse(QRect(QPoint(), size));
-	p.end();
+CachedMasksStats CachedMasksStatistics() {
+	auto &cache = CachedMasksInstance();
+	auto lock = QMutexLocker(&cache.mutex);
+	return cache.stats;
+}
 
-	result.setDevicePixelRatio(ratio);
-	return result;
+QImage EllipseMask(QSize size, double ratio) {
+	const auto key = CachedMaskKey{
+		.type = CachedMaskType::Ellipse,
+		.width = size.width(),
+		.height = size.height(),
+		.ratio = ratio,
+	};
+	return CachedMask(key, [&] {
+		return GenerateEllipseMask(size, ratio);
+	});
 }
 
 std::array<QImage, 4> PrepareCorners(
 		int radius,
 		const style::color &color) {
-	auto result = CornersMask(radius);
-	for (auto &image : result) {
-		style::colorizeImage(image, color->c, &image);
-	}
-	return result;
+	const auto key = CachedMaskKey{
+		.type = CachedMaskType::ColoredCorners,
+		.radius = radius,
+		.ratio = double(style::DevicePixelRatio()),
+		.color = uint32(color->c.rgba()),
+	};
+	return CachedMasksFor(key, [&] {
+		auto result = CornersMask(radius);
+		for (auto &image : result) {
+			style::colorizeImage(image, color->c, &image);
+		}
+		return result;
+	});
 }
 
 [[nodiscard]] QByteArray UnpackGzip(const QByteArray &bytes) {
@@ -548,22 +1054,23 @@ QImage Blur(QImage &&image, bool ignoreAlpha) {
 	const auto buffer = std::make_unique<uint64[]>(w * h);
 	const auto rgb = buffer.get();
 
-	int x, y, i;
-
-	int yw = 0;
 	const int we = w - r1;
-	for (y = 0; y < h; y++) {
-		uint64 cur = BlurGetColors(&pix[yw]);
-		uint64 rgballsum = -radius * cur;
-		uint64 rgbsum = cur * ((r1 * (r1 + 1)) >> 1);
-
-		for (i = 1; i <= radius; i++) {
-			uint64 cur = BlurGetColors(&pix[yw + i * 4]);
-			rgbsum += cur * (r1 - i);
-			rgballsum += cur;
-		}
+	const auto blurRows = [&](int from, int till) {
+		int x, y, i;
+
+		int yw = from * stride;
+		for (y = from; y < till; y++) {
+			uint64 cur = BlurGetColors(&pix[yw]);
+			uint64 rgballsum = -radius * cur;
+			uint64 rgbsum = cur * ((r1 * (r1 + 1)) >> 1);
+
+			for (i = 1; i <= radius; i++) {
+				uint64 cur = BlurGetColors(&pix[yw + i * 4]);
+				rgbsum += cur * (r1 - i);
+				rgballsum += cur;
+			}
 
-		x = 0;
+			x = 0;
 
 #define update(start, middle, end) \
 rgb[y * w + x] = (rgbsum >> 4) & 0x00FF00FF00FF00FFLL; \
@@ -571,32 +1078,36 @@ rgballsum += BlurGetColors(&pix[yw + (start) * 4]) - 2 * BlurGetColors(&pix[yw +
 rgbsum += rgballsum; \
 x++;
 
-		while (x < r1) {
-			update(0, x, x + r1);
-		}
-		while (x < we) {
-			update(x - r1, x, x + r1);
-		}
-		while (x < w) {
-			update(x - r1, x, w - 1);
-		}
+			while (x < r1) {
+				update(0, x, x + r1);
+			}
+			while (x < we) {
+				update(x - r1, x, x + r1);
+			}
+			while (x < w) {
+				update(x - r1, x, w - 1);
+			}
 
 #undef update
 
-		yw += stride;
-	}
+			yw += stride;
+		}
+	};
 
 	const int he = h - r1;
-	for (x = 0; x < w; x++) {
-		uint64 rgballsum = -radius * rgb[x];
-		uint64 rgbsum = rgb[x] * ((r1 * (r1 + 1)) >> 1);
-		for (i = 1; i <= radius; i++) {
-			rgbsum += rgb[i * w + x] * (r1 - i);
-			rgballsum += rgb[i * w + x];
-		}
+	const auto blurColumns = [&](int from, int till) {
+		int x, y, i;
+
+		for (x = from; x < till; x++) {
+			uint64 rgballsum = -radius * rgb[x];
+			uint64 rgbsum = rgb[x] * ((r1 * (r1 + 1)) >> 1);
+			for (i = 1; i <= radius; i++) {
+				rgbsum += rgb[i * w + x] * (r1 - i);
+				rgballsum += rgb[i * w + x];
+			}
 
-		y = 0;
-		int yi = x * 4;
+			y = 0;
+			int yi = x * 4;
 
 #define update(start, middle, end) \
 uint64 res = rgbsum >> 4; \
@@ -609,23 +1120,27 @@ rgbsum += rgballsum; \
 y++; \
 yi += stride;
 
-		while (y < r1) {
-			update(0, y, y + r1);
-		}
-		while (y < he) {
-			update(y - r1, y, y + r1);
-		}
-		while (y < h) {
-			update(y - r1, y, h - 1);
-		}
+			while (y < r1) {
+				update(0, y, y + r1);
+			}
+			while (y < he) {
+				update(y - r1, y, y + r1);
+			}
+			while (y < h) {
+				update(y - r1, y, h - 1);
+			}
 
 #undef update
-	}
+		}
+	};
+	const auto parallel = (w * h >= kBlurParallelMinArea);
+	RunBlurParts(h, parallel, blurRows);
+	RunBlurParts(w, parallel, blurColumns);
 
 	return std::move(image);
 }
 
-[[nodiscard]] QImage BlurLargeImage(QImage &&image, int radius) {
+QImage BlurLargeImage(QImage &&image, int radius) {
 	const auto width = image.width();
 	const auto height = image.height();
 	if (width <= radius || height <= radius || radius < 1) {
@@ -647,9 +1162,9 @@ yi += stride;
 	const auto divsum = radius_p1 * radius_p1;
 
 	const auto dvcount = 256 * divsum;
-	const auto buffers = (div * 3) // stack
-		+ std::max(width, height) // vmin
-		+ widthxheight * 3 // rgb
+	const auto buffers = width // vminx
+		+ height // vminy
+		+ widthxheight // rgb
 		+ dvcount; // dv
 	auto storage = std::vector<int>(buffers);
 	auto taken = 0;
@@ -660,11 +1175,11 @@ yi += stride;
 	};
 
 	// Small buffers
-	const auto stack = take(div * 3).data();
-	const auto vmin = take(std::max(width, height)).data();
+	const auto vminx = take(width).data();
+	const auto vminy = take(height).data();
 
 	// Large buffers
-	const auto rgb = take(widthxheight * 3).data();
+	const auto rgb = reinterpret_cast<uchar*>(take(widthxheight).data());
 	const auto dvs = take(dvcount);
 
 	auto &&ints = ranges::views::ints;
@@ -673,173 +1188,135 @@ yi += stride;
 	}
 	const auto dv = dvs.data();
 
-	// Variables
-	auto stackpointer = 0;
 	for (const auto x : ints(0, width)) {
-		vmin[x] = std::min(x + radius_p1, width_m1);
+		vminx[x] = std::min(x + radius_p1, width_m1);
 	}
 	for (const auto y : ints(0, height)) {
-		auto rinsum = 0;
-		auto ginsum = 0;
-		auto binsum = 0;
-		auto routsum = 0;
-		auto goutsum = 0;
-		auto boutsum = 0;
-		auto rsum = 0;
-		auto gsum = 0;
-		auto bsum = 0;
-
-		const auto y_width = y * width;
+		vminy[y] = std::min(y + radius_p1, height_m1);
+	}
+
+	// Rows and columns are independent inside each pass,
+	// so every part gets its own stack and the result is exact.
+	// The row pass keeps four bytes per pixel in rgb, like the image.
+	const auto blurLine = [&](
+			const uchar *from,
+			uchar *to,
+			int count,
+			int step,
+			const int *vmin,
+			std::vector<BlurStackEntry> &stack) {
+		const auto last = count - 1;
+		auto insum = BlurZero();
+		auto outsum = BlurZero();
+		auto sum = BlurZero();
 		for (const auto i : ints(-radius, radius + 1)) {
-			const auto sir = &stack[(i + radius) * 3];
-			const auto x = std::clamp(i, 0, width_m1);
-			const auto offset = (y_width + x) * 4;
-			sir[0] = pixels[offset];
-			sir[1] = pixels[offset + 1];
-			sir[2] = pixels[offset + 2];
-
-			const auto rbs = radius_p1 - std::abs(i);
-			rsum += sir[0] * rbs;
-			gsum += sir[1] * rbs;
-			bsum += sir[2] * rbs;
-
+			const auto sir = BlurLoad(from + std::clamp(i, 0, last) * step);
+			stack[i + radius].sums = sir;
+			sum = BlurAdd(sum, BlurMultiply(sir, radius_p1 - std::abs(i)));
 			if (i > 0) {
-				rinsum += sir[0];
-				ginsum += sir[1];
-				binsum += sir[2];
+				insum = BlurAdd(insum, sir);
 			} else {
-				routsum += sir[0];
-				goutsum += sir[1];
-				boutsum += sir[2];
+				outsum = BlurAdd(outsum, sir);
 			}
 		}
-		stackpointer = radius;
-
-		for (const auto x : ints(0, width)) {
-			const auto position = (y_width + x) * 3;
-			rgb[position] = dv[rsum];
-			rgb[position + 1] = dv[gsum];
-			rgb[position + 2] = dv[bsum];
-
-			rsum -= routsum;
-			gsum -= goutsum;
-			bsum -= boutsum;
-
-			const auto stackstart = (stackpointer - radius + div) % div;
-			const auto sir = &stack[stackstart * 3];
-
-			routsum -= sir[0];
-			goutsum -= sir[1];
-			boutsum -= sir[2];
-
-			const auto offset = (y_width + vmin[x]) * 4;
-			sir[0] = pixels[offset];
-			sir[1] = pixels[offset + 1];
-			sir[2] = pixels[offset + 2];
-			rinsum += sir[0];
-			ginsum += sir[1];
-			binsum += sir[2];
-
-			rsum += rinsum;
-			gsum += ginsum;
-			bsum += binsum;
-			{
-				stackpointer = (stackpointer + 1) % div;
-				const auto sir = &stack[stackpointer * 3];
-
-				routsum += sir[0];
-				goutsum += sir[1];
-				boutsum += sir[2];
-
-				rinsum -= sir[0];
-				ginsum -= sir[1];
-				binsum -= sir[2];
-			}
+		auto stackpointer = radius;
+		int32 values[4];
+		for (const auto i : ints(0, count)) {
+			BlurStore(sum, values);
+			const auto out = to + i * step;
+			out[0] = dv[values[0]];
+			out[1] = dv[values[1]];
+			out[2] = dv[values[2]];
+
+			sum = BlurSubtract(sum, outsum);
+
+			auto &start = stack[(stackpointer - radius + div) % div].sums;
+			outsum = BlurSubtract(outsum, start);
+			start = BlurLoad(from + vmin[i] * step);
+			insum = BlurAdd(insum, start);
+			sum = BlurAdd(sum, insum);
+
+			stackpointer = (stackpointer + 1) % div;
+			const auto &next = stack[stackpointer].sums;
+			outsum = BlurAdd(outsum, next);
+			insum = BlurSubtract(insum, next);
 		}
-	}
-
-	for (const auto y : ints(0, height)) {
-		vmin[y] = std::min(y + radius_p1, height_m1) * width;
-	}
-	for (const auto x : ints(0, width)) {
-		auto rinsum = 0;
-		auto ginsum = 0;
-		auto binsum = 0;
-		auto routsum = 0;
-		auto goutsum = 0;
-		auto boutsum = 0;
-		auto rsum = 0;
-		auto gsum = 0;
-		auto bsum = 0;
-		for (const auto i : ints(-radius, radius + 1)) {
-			const auto y = std::clamp(i, 0, height_m1);
-			const auto position = (y * width + x) * 3;
-			const auto sir = &stack[(i + radius) * 3];
-
-			sir[0] = rgb[position];
-			sir[1] = rgb[position + 1];
-			sir[2] = rgb[position + 2];
-
-			const auto rbs = radius_p1 - std::abs(i);
-			rsum += sir[0] * rbs;
-			gsum += sir[1] * rbs;
-			bsum += sir[2] * rbs;
-			if (i > 0) {
-				rinsum += sir[0];
-				ginsum += sir[1];
-				binsum += sir[2];
-			} else {
-				routsum += sir[0];
-				goutsum += sir[1];
-				boutsum += sir[2];
-			}
+	};
+	const auto blurRows = [&](int from, int till) {
+		auto stack = std::vector<BlurStackEntry>(div);
+		for (const auto y : ints(from, till)) {
+			const auto offset = y * width * 4;
+			blurLine(pixels + offset, rgb + offset, width, 4, vminx, stack);
 		}
-		stackpointer = radius;
-		for (const auto y : ints(0, height)) {
-			const auto offset = (y * width + x) * 4;
-			pixels[offset] = dv[rsum];
-			pixels[offset + 1] = dv[gsum];
-			pixels[offset + 2] = dv[bsum];
-			rsum -= routsum;
-			gsum -= goutsum;
-			bsum -= boutsum;
-
-			const auto stackstart = (stackpointer - radius + div) % div;
-			const auto sir = &stack[stackstart * 3];
-
-			routsum -= sir[0];
-			goutsum -= sir[1];
-			boutsum -= sir[2];
-
-			const auto position = (vmin[y] + x) * 3;
-			sir[0] = rgb[position];
-			sir[1] = rgb[position + 1];
-			sir[2] = rgb[position + 2];
-
-			rinsum += sir[0];
-			ginsum += sir[1];
-			binsum += sir[2];
-
-			rsum += rinsum;
-			gsum += ginsum;
-			bsum += binsum;
-			{
-				stackpointer = (stackpointer + 1) % div;
-				const auto sir = &stack[stackpointer * 3];
-
-				routsum += sir[0];
-				goutsum += sir[1];
-				boutsum += sir[2];
-
-				rinsum -= sir[0];
-				ginsum -= sir[1];
-				binsum -= sir[2];
-			}
+	};
+	const auto blurColumns = [&](int from, int till) {
+		auto stack = std::vector<BlurStackEntry>(div);
+		for (const auto x : ints(from, till)) {
+			const auto offset = x * 4;
+			blurLine(
+				rgb + offset,
+				pixels + offset,
+				height,
+				width * 4,
+				vminy,
+				stack);
 		}
-	}
+	};
+	const auto parallel = (widthxheight >= kBlurParallelMinArea);
+	RunBlurParts(height, parallel, blurRows);
+	RunBlurParts(width, parallel, blurColumns);
 	return std::move(image);
 }
 
+namespace {
+
+// Each level halves the size, the radius left should stay large enough
+// for the smooth upscale not to show the blocks. It should also stay
+// smaller than the sides, otherwise the exact blur leaves it as is.
+[[nodiscard]] int BlurDownscaleLevel(QSize size, int radius) {
+	auto level = 0;
+	while (level < kBlurFastMaxLevel) {
+		const auto factor = (1 << (level + 1));
+		const auto reducedRadius = (radius + factor / 2) / factor;
+		const auto reducedSide = std::min(size.width(), size.height())
+			/ factor;
+		if (reducedRadius < kBlurFastMinRadius
+			|| reducedSide < kBlurFastMinSide
+			|| reducedRadius >= reducedSide) {
+			break;
+		}
+		++level;
+	}
+	return level;
+}
+
+} // namespace
+
+QImage BlurLargeImageFast(QImage &&image, int radius) {
+	const auto level = BlurDownscaleLevel(image.size(), radius);
+	if (!level) {
+		return BlurLargeImage(std::move(image), radius);
+	}
+	const auto size = image.size();
+	const auto ratio = image.devicePixelRatio();
+	const auto factor = (1 << level);
+	auto small = image.scaled(
+		size.width() / factor,
+		size.height() / factor,
+		Qt::IgnoreAspectRatio,
+		Qt::SmoothTransformation);
+	image = QImage();
+	small = BlurLargeImage(
+		std::move(small),
+		(radius + factor / 2) / factor);
+	auto result = small.scaled(
+		size,
+		Qt::IgnoreAspectRatio,
+		Qt::SmoothTransformation);
+	result.setDevicePixelRatio(ratio);
+	return result;
+}
+
 [[nodiscard]] QImage DitherImage(const QImage &image) {
 	Expects(image.bytesPerLine() == image.width() * 4);
 
@@ -988,13 +1465,25 @@ QImage Circle(QImage &&image, QRect target) {
 		QImage::Format_ARGB32_Premultiplied);
 	Assert(!image.isNull());
 
-	const auto ratio = image.devicePixelRatio();
-	auto p = QPainter(&image);
-	p.setCompositionMode(QPainter::CompositionMode_DestinationIn);
-	p.drawImage(
-		QRectF(target.topLeft() / ratio, target.size() / ratio),
-		EllipseMaskCached(target.size()));
-	p.end();
+	// Detach before reading bytesPerLine, see Round() below.
+	const auto ints = reinterpret_cast<uint32*>(image.bits());
+	const auto edges = EllipseEdgesCached(target.size());
+	const auto width = target.width();
+	const auto perLine = image.bytesPerLine() / sizeof(uint32);
+	auto line = ints + target.y() * perLine + target.x();
+	const auto apply = [](uint32 *ints, const uchar *values, int count) {
+		for (auto x = 0; x != count; ++x) {
+			ints[x] = MultiplyByAlphaRounded(ints[x], values[x]);
+		}
+	};
+	for (auto y = 0, height = target.height(); y != height; ++y) {
+		const auto left = edges->lefts[y];
+		const auto right = edges->rights[y];
+		const auto values = edges->values.data() + edges->offsets[y];
+		apply(line, values, left);
+		apply(line + width - right, values + left, right);
+		line += perLine;
+	}
 
 	return std::move(image);
 }
@@ -1003,7 +1492,11 @@ QImage Round(
 		QImage &&image,
 		CornersMaskRef mask,
 		QRect target) {
-	if (target.isNull()) {
+	if (mask.empty()) {
+		// Callers rely on the premultiplied result even without corners.
+		return std::move(image).convertToFormat(
+			QImage::Format_ARGB32_Premultiplied);
+	} else if (target.isNull()) {
 		target = QRect(QPoint(), image.size());
 	} else {
 		Assert(QRect(QPoint(), image.size()).contains(target));
@@ -1139,23 +1632,11 @@ QImage Colored(QImage &&image, QColor add) {
 	}
 
 	if (const auto pix = image.bits()) {
-		const auto ca = add.alpha();
-		const auto cr = add.red() * (ca + 1);
-		const auto cg = add.green() * (ca + 1);
-		const auto cb = add.blue() * (ca + 1);
-		const auto ra = (0x100 - ca) * 0x100;
 		const auto w = image.width();
 		const auto h = image.height();
-		const auto add = image.bytesPerLine() - (w * 4);
-		auto i = index_type();
+		const auto perLine = image.bytesPerLine();
 		for (auto y = 0; y != h; ++y) {
-			for (auto to = i + (w * 4); i != to; i += 4) {
-				const auto a = pix[i + 3] + 1;
-				pix[i + 0] = (ra * pix[i + 0] + a * cb) >> 16;
-				pix[i + 1] = (ra * pix[i + 1] + a * cg) >> 16;
-				pix[i + 2] = (ra * pix[i + 2] + a * cr) >> 16;
-			}
-			i += add;
+			ColorLine(pix + y * index_type(perLine), w, add);
 		}
 	}
 	return std::move(image);
@@ -1208,35 +1689,34 @@ QImage Prepare(QImage image, int w, int h, const PrepareArgs &args) {
 				: Qt::SmoothTransformation));
 		Assert(!image.isNull());
 	}
-	auto outer = args.outer;
-	if (!outer.isEmpty()) {
-		const auto ratio = style::DevicePixelRatio();
-		outer *= ratio;
-		if (outer != QSize(w, h)) {
-			image.setDevicePixelRatio(ratio);
-			auto result = QImage(outer, QImage::Format_ARGB32_Premultiplied);
-			result.setDevicePixelRatio(ratio);
-			if (args.options & Images::Option::TransparentBackground) {
-				result.fill(Qt::transparent);
-			}
-			{
-				QPainter p(&result);
-				if (!(args.options & Images::Option::TransparentBackground)) {
-					if (w < outer.width() || h < outer.height()) {
-						p.fillRect(
-							QRect({}, result.size() / ratio),
-							Qt::black);
-					}
-				}
-				p.drawImage(
-					(result.width() - image.width()) / (2 * ratio),
-					(result.height() - image.height()) / (2 * ratio),
-					image);
-			}
-			image = std::move(result);
-			Assert(!image.isNull());
-		}
+	const auto ratio = style::DevicePixelRatio();
+	const auto outer = args.outer * ratio;
+	if (!outer.isEmpty() && outer != QSize(w, h)) {
+		const auto transparent = bool(args.options
+			& Images::Option::TransparentBackground);
+		const auto position = QPoint(
+			(outer.width() - image.width()) / (2 * ratio),
+			(outer.height() - image.height()) / (2 * ratio)) * ratio;
+		auto result = TakePrepareStorage(args.storage, outer);
+		ComposeCentered(
+			result,
+			std::move(image),
+			position,
+			transparent ? uint32(0) : kPrepareBlack,
+			(!transparent && (w < outer.width() || h < outer.height())));
+		image = std::move(result);
+	} else if (args.storage
+		&& !image.isDetached()
+		&& (args.colored
+			|| (args.options & (Option::RoundCircle
+				| Option::RoundLarge
+				| Option::RoundSmall)))) {
+		// Copy into the provided buffer instead of detaching the source.
+		auto result = TakePrepareStorage(args.storage, image.size());
+		ComposeCentered(result, std::move(image), QPoint(), 0, false);
+		image = std::move(result);
 	}
+	Assert(!image.isNull());
 
 	if (args.options
 		& (Option::RoundCircle | Option::RoundLarge | Option::RoundSmall)) {
@@ -26,7 +26,12 @@ enum class ImageRoundRadius {
 namespace Images {
 
 [[nodiscard]] QPixmap PixmapFast(QImage &&image);
+
 [[nodiscard]] QImage BlurLargeImage(QImage &&image, int radius);
+
+// Large radii are applied to a downscaled copy that is scaled back,
+// which is much faster and visually close, but not exact.
+[[nodiscard]] QImage BlurLargeImageFast(QImage &&image, int radius);
 [[nodiscard]] QImage DitherImage(const QImage &image);
 
 [[nodiscard]] QImage GenerateGradient(
@@ -102,6 +107,45 @@ struct CornersMaskRef {
 	int radius,
 	const style::color &color);
 
+enum class CachedMaskType : uchar {
+	Corners,
+	ColoredCorners,
+	Ellipse,
+	RippleRoundRect,
+	RippleEllipse,
+	EllipseEdges,
+};
+
+struct CachedMaskKey {
+	CachedMaskType type = CachedMaskType::Corners;
+	int width = 0;
+	int height = 0;
+	int radius = 0;
+	double ratio = 1.;
+	uint32 color = 0;
+
+	friend inline constexpr auto operator<=>(
+		const CachedMaskKey &a,
+		const CachedMaskKey &b) = default;
+	friend inline constexpr bool operator==(
+		const CachedMaskKey &a,
+		const CachedMaskKey &b) = default;
+};
+
+struct CachedMasksStats {
+	int64 hits = 0;
+	int64 misses = 0;
+	int64 bytes = 0;
+	int count = 0;
+};
+
+// Process-wide, the least recently used masks are dropped
+// when all of them together take more than a few megabytes.
+[[nodiscard]] QImage CachedMask(
+	const CachedMaskKey &key,
+	Fn<QImage()> generate);
+[[nodiscard]] CachedMasksStats CachedMasksStatistics();
+
 [[nodiscard]] QByteArray UnpackGzip(const QByteArray &bytes);
 
 // Try to read images up to 64MB.
@@ -176,6 +220,9 @@ struct PrepareArgs {
 	Options options;
 	QSize outer;
 
+	// If it has the resulting size it is taken for the result pixels.
+	QImage *storage = nullptr;
+
 	[[nodiscard]] PrepareArgs blurred() const {
 		auto result = *this;
 		result.options |= Option::Blur;
@@ -38,6 +38,10 @@ void StopShortAnimation();
 void StartManager(int scale);
 void StopManager();
 
+// Fired in StopManager() before the fonts are destroyed,
+// caches holding font engines should be cleared here.
+[[nodiscard]] rpl::producer<> ManagerStopping();
+
 [[nodiscard]] rpl::producer<> PaletteChanged();
 [[nodiscard]] int PaletteVersion();
 void NotifyPaletteChanged();
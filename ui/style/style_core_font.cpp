@@ -18,6 +18,8 @@
 #include <QtGui/QFontInfo>
 #include <QtGui/QFontDatabase>
 
+#include <atomic>
+
 void style_InitFontsResource() {
 #ifdef Q_OS_MAC // Use resources from the .app bundle on macOS.
 
@@ -90,7 +92,47 @@ bool Started = false;
 base::flat_map<QString, int> FontFamilyIndices;
 std::vector<QString> FontFamilies;
 base::flat_map<uint32, std::unique_ptr<ResolvedFont>> FontsByKey;
-base::flat_map<uint64, uint32> QtFontsKeys;
+
+// Insert-only open addressing tables for lookups from any thread
+// without a lock.
+//
+// Only the main thread inserts. When a table gets half full its entries
+// are moved to a twice larger one. Old tables and entries may still be
+// read by other threads, so they are never destroyed. All the old tables
+// together take less memory than the last one.
+template <typename Entry>
+struct LookupTable {
+	explicit LookupTable(int capacity)
+	: slots(std::make_unique<std::atomic<const Entry*>[]>(capacity))
+	, capacity(capacity) {
+	}
+
+	std::unique_ptr<std::atomic<const Entry*>[]> slots;
+	int capacity = 0;
+	int count = 0;
+};
+
+template <typename Entry>
+struct LookupTables {
+	std::vector<std::unique_ptr<Entry>> entries;
+	std::vector<std::unique_ptr<LookupTable<Entry>>> tables;
+	std::atomic<const LookupTable<Entry>*> published = nullptr;
+};
+
+// Resolved fonts by their QFont properties.
+struct AdjustEntry {
+	QString family;
+	uint64 key = 0;
+	not_null<const FontResolveResult*> result;
+};
+LookupTables<AdjustEntry> AdjustTables;
+
+// Fonts by their FontKey().
+struct FontEntry {
+	uint32 key = 0;
+	not_null<FontData*> data;
+};
+LookupTables<FontEntry> FontTables;
 
 [[nodiscard]] uint32 FontKey(int size, FontFlags flags, int family) {
 	return (uint32(family) << 18)
@@ -99,15 +141,7 @@ base::flat_map<uint64, uint32> QtFontsKeys;
 }
 
 [[nodiscard]] uint64 QtFontKey(const QFont &font) {
-	static auto Families = base::flat_map<QString, int>();
-
-	const auto family = font.family();
-	auto i = Families.find(family);
-	if (i == end(Families)) {
-		i = Families.emplace(family, Families.size()).first;
-	}
-	return (uint64(i->second) << 24)
-		| (uint64(font.weight()) << 16)
+	return (uint64(font.weight()) << 16)
 		| (uint64(font.bold() ? 1 : 0) << 15)
 		| (uint64(font.italic() ? 1 : 0) << 14)
 		| (uint64(font.underline() ? 1 : 0) << 13)
@@ -380,6 +414,114 @@ struct Metrics {
 	};
 }
 
+[[nodiscard]] uint32 AdjustHash(const QString &family, uint64 key) {
+	return uint32(qHash(family) ^ qHash(key));
+}
+
+[[nodiscard]] uint32 EntryHash(const AdjustEntry &entry) {
+	return AdjustHash(entry.family, entry.key);
+}
+
+[[nodiscard]] uint32 FontHash(uint32 key) {
+	return uint32(qHash(key));
+}
+
+[[nodiscard]] uint32 EntryHash(const FontEntry &entry) {
+	return FontHash(entry.key);
+}
+
+template <typename Entry, typename Matches>
+[[nodiscard]] const Entry *FindEntry(
+		const LookupTable<Entry> &table,
+		uint32 hash,
+		Matches &&matches) {
+	const auto mask = uint32(table.capacity - 1);
+	auto index = hash & mask;
+	while (const auto entry = table.slots[index].load(
+			std::memory_order_acquire)) {
+		if (matches(*entry)) {
+			return entry;
+		}
+		index = (index + 1) & mask;
+	}
+	return nullptr;
+}
+
+template <typename Entry, typename Matches>
+[[nodiscard]] const Entry *FindPublishedEntry(
+		const LookupTables<Entry> &tables,
+		uint32 hash,
+		Matches &&matches) {
+	const auto table = tables.published.load(std::memory_order_acquire);
+	return table
+		? FindEntry(*table, hash, std::forward<Matches>(matches))
+		: nullptr;
+}
+
+template <typename Entry>
+void InsertEntry(LookupTable<Entry> &table, const Entry *entry) {
+	Expects(entry != nullptr);
+
+	const auto mask = uint32(table.capacity - 1);
+	auto index = EntryHash(*entry) & mask;
+	while (table.slots[index].load(std::memory_order_relaxed)) {
+		index = (index + 1) & mask;
+	}
+	table.slots[index].store(entry, std::memory_order_release);
+	++table.count;
+}
+
+template <typename Entry>
+void PublishEntry(LookupTables<Entry> &tables, Entry &&entry) {
+	constexpr auto kMinCapacity = 64;
+
+	const auto current = tables.tables.empty()
+		? nullptr
+		: tables.tables.back().get();
+	const auto raw = tables.entries.emplace_back(
+		std::make_unique<Entry>(std::move(entry))).get();
+	if (current && (current->count + 1) * 2 <= current->capacity) {
+		InsertEntry(*current, raw);
+		return;
+	}
+	auto grown = std::make_unique<LookupTable<Entry>>(current
+		? (current->capacity * 2)
+		: kMinCapacity);
+	for (const auto &existing : tables.entries) {
+		InsertEntry(*grown, existing.get());
+	}
+	tables.published.store(grown.get(), std::memory_order_release);
+	tables.tables.push_back(std::move(grown));
+}
+
+void PublishFont(
+		uint32 key,
+		not_null<FontData*> data,
+		not_null<const FontResolveResult*> result) {
+	PublishEntry(FontTables, FontEntry{ .key = key, .data = data });
+
+	// Different keys may resolve to the same QFont, the first one is kept.
+	const auto &font = result->font;
+	const auto family = font.family();
+	const auto qtKey = QtFontKey(font);
+	const auto current = AdjustTables.tables.empty()
+		? nullptr
+		: AdjustTables.tables.back().get();
+	const auto exists = current && FindEntry(
+		*current,
+		AdjustHash(family, qtKey),
+		[&](const AdjustEntry &entry) {
+			return (entry.key == qtKey) && (entry.family == family);
+		});
+	if (!exists) {
+		PublishEntry(AdjustTables, AdjustEntry{
+			.family = family,
+			.key = qtKey,
+			.result = result,
+		});
+	}
+}
+
 } // namespace
 
 void StartFonts() {
@@ -416,7 +558,25 @@ void StartFonts() {
 }
 
 void DestroyFonts() {
-	base::take(FontsByKey);
+	struct Retired {
+		decltype(AdjustTables.entries) adjustEntries;
+		decltype(AdjustTables.tables) adjustTables;
+		decltype(FontTables.entries) fontEntries;
+		decltype(FontTables.tables) fontTables;
+		decltype(FontsByKey) fonts;
+	};
+	AdjustTables.published.store(nullptr, std::memory_order_release);
+	FontTables.published.store(nullptr, std::memory_order_release);
+
+	// Other threads may still read the published tables and the fonts
+	// they point to, so all of them are intentionally leaked.
+	[[maybe_unused]] const auto leaked = new Retired{
+		base::take(AdjustTables.entries),
+		base::take(AdjustTables.tables),
+		base::take(FontTables.entries),
+		base::take(FontTables.tables),
+		base::take(FontsByKey),
+	};
 }
 
 int RegisterFontFamily(const QString &family) {
@@ -518,11 +678,20 @@ void Font::init(
 					flags,
 					size),
 				modified)).first;
-		QtFontsKeys.emplace(QtFontKey(i->second->data.f), key);
+		PublishFont(key, &i->second->data, &i->second->result);
 	}
 	_data = &i->second->data;
 }
 
+Font FindFont(int size, FontFlags flags, int family) {
+	const auto key = FontKey(size, flags, family);
+	const auto entry = FindPublishedEntry(
+		FontTables,
+		FontHash(key),
+		[&](const FontEntry &entry) { return (entry.key == key); });
+	return entry ? Font(entry->data.get()) : Font();
+}
+
 OwnedFont::OwnedFont(const QString &custom, FontFlags flags, int size)
 : _data(ResolveFont(custom, flags, size), nullptr) {
 	_font._data = &_data;
@@ -531,11 +700,15 @@ OwnedFont::OwnedFont(const QString &custom, FontFlags flags, int size)
 } // namespace internal
 
 const FontResolveResult *FindAdjustResult(const QFont &font) {
+	const auto family = font.family();
 	const auto key = internal::QtFontKey(font);
-	const auto i = internal::QtFontsKeys.find(key);
-	return (i != end(internal::QtFontsKeys))
-		? &internal::FontsByKey[i->second]->result
-		: nullptr;
+	const auto entry = internal::FindPublishedEntry(
+		internal::AdjustTables,
+		internal::AdjustHash(family, key),
+		[&](const internal::AdjustEntry &entry) {
+			return (entry.key == key) && (entry.family == family);
+		});
+	return entry ? entry->result.get() : nullptr;
 }
 
 } // namespace style
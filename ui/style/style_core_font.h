@@ -47,6 +47,8 @@ struct FontResolveResult {
 	int requestedSize = 0;
 	FontFlags requestedFlags;
 };
+
+// Thread safe, finds only fonts already created on the main thread.
 [[nodiscard]] const FontResolveResult *FindAdjustResult(const QFont &font);
 
 namespace internal {
@@ -62,6 +64,11 @@ class Font;
 using FontVariants = std::array<Font, kFontVariants>;
 
 class FontData;
+class Font;
+
+// Thread safe, returns an empty Font if it wasn't created on main yet.
+[[nodiscard]] Font FindFont(int size, FontFlags flags, int family);
+
 class Font final {
 public:
 	Font(Qt::Initialization = Qt::Uninitialized) {
@@ -90,6 +97,7 @@ private:
 
 	void init(int size, FontFlags flags, int family, FontVariants *modified);
 	friend void StartManager();
+	friend Font FindFont(int size, FontFlags flags, int family);
 
 	explicit Font(FontData *data) : _data(data) {
 	}
@@ -17,6 +17,10 @@
 #include "base/platform/base_platform_info.h"
 #include "styles/style_basic.h"
 
+#include <crl/crl_async.h>
+#include <crl/crl_on_main.h>
+#include <crl/crl_semaphore.h>
+
 namespace Ui {
 
 const QString kQEllipsis = u"..."_q;
@@ -28,6 +32,60 @@ namespace {
 
 constexpr auto kDefaultSpoilerCacheCapacity = 24;
 
+// Owned and destroyed on main, the async worker only measures it.
+struct AsyncPreparing {
+	String text;
+	DetachedFonts fonts;
+	Qt::LayoutDirection direction = Qt::LayoutDirectionAuto;
+	Fn<void(String&&)> done;
+	crl::semaphore measured;
+};
+
+class AsyncPreparings final {
+public:
+	AsyncPreparings();
+
+	[[nodiscard]] not_null<AsyncPreparing*> add(uint64 id);
+	[[nodiscard]] std::unique_ptr<AsyncPreparing> take(uint64 id);
+
+private:
+	base::flat_map<uint64, std::unique_ptr<AsyncPreparing>> _list;
+	rpl::lifetime _lifetime;
+
+};
+
+AsyncPreparings::AsyncPreparings() {
+	style::ManagerStopping() | rpl::start_with_next([=] {
+		// Destroy the pending strings, with their links, custom emoji
+		// and detached fonts, while the style fonts are still alive.
+		for (const auto &[id, preparing] : _list) {
+			preparing->measured.acquire();
+		}
+		_list.clear();
+	}, _lifetime);
+}
+
+not_null<AsyncPreparing*> AsyncPreparings::add(uint64 id) {
+	return _list.emplace(
+		id,
+		std::make_unique<AsyncPreparing>()).first->second.get();
+}
+
+std::unique_ptr<AsyncPreparing> AsyncPreparings::take(uint64 id) {
+	const auto i = _list.find(id);
+	if (i == end(_list)) {
+		return nullptr;
+	}
+	auto result = std::move(i->second);
+	_list.erase(i);
+	return result;
+}
+
+[[nodiscard]] AsyncPreparings &AsyncPreparingsList() {
+	static auto result = AsyncPreparings();
+	return result;
+}
+
 [[nodiscard]] Qt::LayoutDirection StringDirection(
 		const QString &str,
 		int from,
@@ -68,6 +126,30 @@ bool IsParagraphSeparator(QChar ch) {
 }
 
 } // namespace
+
+// Line breaks for the last simple width layout, with a checkpoint at
+// every paragraph start. Paragraphs that were laid out in a single line
+// keep their line for any width not less than the "required" one, so
+// a layout for a new width resumes from the first paragraph that changes.
+struct String::LineBreaksCache {
+	struct Paragraph {
+		int blockIndex = 0; // First block of the paragraph.
+		int lineIndex = 0; // Geometry line index before the paragraph.
+		int lines = 0; // Lines enumerated before the paragraph.
+		int top = 0;
+		uint16 quoteIndex = 0; // Quote index before the paragraph.
+		uint16 paragraphQuoteIndex = 0;
+		QFixed required = -1; // -1 if the paragraph took several lines.
+	};
+
+	std::vector<QFixed> lineWidths;
+	std::vector<int> lineBottoms;
+	std::vector<Paragraph> paragraphs;
+	int width = 0;
+	bool breakEverywhere = false;
+	bool valid = false;
+};
+
 } // namespace Ui::Text
 
 const TextParseOptions kDefaultTextOptions = {
@@ -153,9 +235,11 @@ GeometryDescriptor SimpleGeometry(
 
 	// Try to minimize captured values (to minimize Fn allocations).
 	if (!elisionLines) {
-		return wrap([=](int line) {
+		auto result = wrap([=](int line) {
 			return LineGeometry{ .width = availableWidth };
 		});
+		result.uniformWidth = availableWidth;
+		return result;
 	} else if (!elisionRemoveFromEnd) {
 		return wrap([=](int line) {
 			return LineGeometry{
@@ -503,6 +587,68 @@ String &String::operator=(String &&other) = default;
 
 String::~String() = default;
 
+void String::PrepareMarkedTextAsync(
+		const style::TextStyle &st,
+		const TextWithEntities &textWithEntities,
+		Fn<void(String&&)> done,
+		const TextParseOptions &options,
+		int minResizeWidth,
+		const std::any &context) {
+	static auto LastId = uint64();
+	const auto id = ++LastId;
+	const auto raw = AsyncPreparingsList().add(id);
+	raw->text = String(minResizeWidth);
+	raw->direction = options.dir;
+	raw->done = std::move(done);
+	auto &text = raw->text;
+	text._st = &st;
+	{
+		// Link handlers and custom emoji are created here, on main.
+		Parser parser(&text, textWithEntities, options, context, false);
+	}
+	raw->fonts = text.detachTextBlockFonts();
+	crl::async([=] {
+		raw->text.measureTextBlocks(&raw->fonts);
+		raw->text.recountNaturalSize(true, raw->direction);
+		raw->measured.release();
+
+		// Capture only the id, so that if this is never invoked
+		// nothing is destroyed on the worker thread.
+		crl::on_main([=] {
+			if (const auto preparing = AsyncPreparingsList().take(id)) {
+				preparing->done(std::move(preparing->text));
+			}
+		});
+	});
+}
+
+DetachedFonts String::detachTextBlockFonts() const {
+	auto result = DetachedFonts();
+	for (const auto &block : _blocks) {
+		if (block->type() == TextBlockType::Text) {
+			result.add(WithFlags(_st->font, block->flags()));
+		}
+	}
+	return result;
+}
+
+void String::measureTextBlocks(const DetachedFonts *detached) {
+	_words.clear();
+	for (auto i = _blocks.begin(), e = _blocks.end(); i != e; ++i) {
+		if ((*i)->type() == TextBlockType::Text) {
+			i->unsafe<TextBlock>().measure(
+				_st->font,
+				_text,
+				countBlockLength(i, e),
+				_minResizeWidth,
+				_words,
+				nullptr,
+				detached);
+		}
+	}
+	_words.shrink_to_fit();
+}
+
 void String::setText(const style::TextStyle &st, const QString &text, const TextParseOptions &options) {
 	_st = &st;
 	clear();
@@ -515,6 +661,9 @@ void String::setText(const style::TextStyle &st, const QString &text, const Text
 void String::recountNaturalSize(
 		bool initial,
 		Qt::LayoutDirection optionsDirection) {
+	_lineBreaks = nullptr;
+	_drawLineBreaks = nullptr;
+
 	auto lastNewline = (NewlineBlock*)nullptr;
 	auto lastNewlineStart = 0;
 	const auto computeParagraphDirection = [&](int paragraphEnd) {
@@ -802,7 +951,7 @@ void String::insertModifications(int position, int delta) {
 	} else {
 		modifications.insert(i, {
 			.position = position,
-			.skipped = uint16(delta < 0 ? (-delta) : 0),
+			.skipped = (delta < 0) ? (-delta) : 0,
 			.added = (delta > 0),
 		});
 	}
@@ -903,15 +1052,116 @@ void String::enumerateLines(
 		return;
 	}
 	const auto width = std::max(w, _minResizeWidth);
-	auto g = SimpleGeometry(width, 0, 0, false);
-	g.breakEverywhere = breakEverywhere;
-	enumerateLines(g, std::forward<Callback>(callback));
+	const auto &cache = validateLineBreaks(
+		_lineBreaks,
+		width,
+		breakEverywhere);
+	for (auto i = 0, count = int(cache.lineWidths.size()); i != count; ++i) {
+		callback(cache.lineWidths[i], cache.lineBottoms[i]);
+	}
+}
+
+const String::LineBreaksCache &String::validateLineBreaks(
+		std::unique_ptr<LineBreaksCache> &record,
+		int width,
+		bool breakEverywhere) const {
+	if (!record) {
+		record = std::make_unique<LineBreaksCache>();
+	}
+	auto &cache = *record;
+	if (cache.valid
+		&& cache.width == width
+		&& cache.breakEverywhere == breakEverywhere) {
+		return cache;
+	}
+	auto reuse = 0;
+	const auto count = int(cache.paragraphs.size());
+	if (cache.valid && cache.breakEverywhere == breakEverywhere) {
+		while (reuse < count) {
+			const auto required = cache.paragraphs[reuse].required;
+			if (required < 0 || required > width) {
+				break;
+			}
+			++reuse;
+		}
+	}
+	cache.width = width;
+	cache.breakEverywhere = breakEverywhere;
+	cache.valid = true;
+	if (reuse > 0 && reuse == count) {
+		return cache;
+	} else if (reuse < count) {
+		// Keep the first changed paragraph as the point to resume from.
+		cache.paragraphs.erase(
+			cache.paragraphs.begin() + reuse + 1,
+			cache.paragraphs.end());
+		const auto lines = cache.paragraphs.back().lines;
+		cache.lineWidths.resize(lines);
+		cache.lineBottoms.resize(lines);
+	} else {
+		cache.paragraphs.clear();
+		cache.lineWidths.clear();
+		cache.lineBottoms.clear();
+	}
+	auto geometry = SimpleGeometry(width, 0, 0, false);
+	geometry.breakEverywhere = breakEverywhere;
+	enumerateLines(geometry, &cache, [&](QFixed lineWidth, int lineBottom) {
+		cache.lineWidths.push_back(lineWidth);
+		cache.lineBottoms.push_back(lineBottom);
+	});
+	return cache;
+}
+
+String::ParagraphStart String::findParagraphAbove(
+		int width,
+		bool breakEverywhere,
+		int top) const {
+	if (isEmpty() || width < _minResizeWidth) {
+		return {};
+	}
+	// Painting keeps its own record, so that measuring at another width
+	// doesn't throw away the layout of the width being painted.
+	const auto &paragraphs = validateLineBreaks(
+		_drawLineBreaks,
+		width,
+		breakEverywhere).paragraphs;
+	auto i = ranges::upper_bound(
+		paragraphs,
+		top,
+		ranges::less(),
+		&LineBreaksCache::Paragraph::top);
+	while (i != begin(paragraphs)) {
+		// Only paragraphs outside of quotes can be started from scratch.
+		const auto &paragraph = *--i;
+		if (paragraph.blockIndex > 0
+			&& paragraph.blockIndex < int(_blocks.size())
+			&& !paragraph.quoteIndex
+			&& !paragraph.paragraphQuoteIndex) {
+			return {
+				.blockIndex = paragraph.blockIndex,
+				.lineIndex = paragraph.lineIndex,
+				.top = paragraph.top,
+			};
+		}
+	}
+	return {};
 }
 
 template <typename Callback>
 void String::enumerateLines(
 		GeometryDescriptor geometry,
 		Callback &&callback) const {
+	enumerateLines(
+		std::move(geometry),
+		nullptr,
+		std::forward<Callback>(callback));
+}
+
+template <typename Callback>
+void String::enumerateLines(
+		GeometryDescriptor geometry,
+		LineBreaksCache *record,
+		Callback &&callback) const {
 	if (isEmpty()) {
 		return;
 	}
@@ -932,6 +1182,16 @@ void String::enumerateLines(
 	auto lineElided = false;
 	auto widthLeft = QFixed(0);
 	auto lineIndex = 0;
+	auto required = QFixed(0);
+	const auto finishParagraph = [&] {
+		if (record && !record->paragraphs.empty()) {
+			auto &paragraph = record->paragraphs.back();
+			const auto lines = int(record->lineWidths.size());
+			paragraph.required = (lines == paragraph.lines + 1)
+				? required
+				: QFixed(-1);
+		}
+	};
 	const auto initNextLine = [&] {
 		const auto line = geometry.layout(lineIndex++);
 		lineLeft = line.left;
@@ -945,6 +1205,18 @@ void String::enumerateLines(
 	const auto initNextParagraph = [&](
 			TextBlocks::const_iterator i,
 			int16 paragraphIndex) {
+		if (record) {
+			finishParagraph();
+			record->paragraphs.push_back({
+				.blockIndex = int(i - _blocks.cbegin()),
+				.lineIndex = lineIndex,
+				.lines = int(record->lineWidths.size()),
+				.top = top,
+				.quoteIndex = uint16(qindex),
+				.paragraphQuoteIndex = uint16(paragraphIndex),
+			});
+			required = 0;
+		}
 		if (qindex != paragraphIndex) {
 			top += qpadding.bottom();
 			qindex = paragraphIndex;
@@ -955,8 +1227,26 @@ void String::enumerateLines(
 		}
 		initNextLine();
 	};
+	const auto fitted = [&](QFixed newWidthLeft) {
+		if (record) {
+			accumulate_max(required, lineWidth - newWidthLeft);
+		}
+	};
 
-	if ((*_blocks.cbegin())->type() != TextBlockType::Newline) {
+	auto from = _blocks.cbegin();
+	if (record && !record->paragraphs.empty()) {
+		const auto paragraph = record->paragraphs.back();
+		record->paragraphs.pop_back();
+
+		top = paragraph.top;
+		qindex = paragraph.quoteIndex;
+		quote = quoteByIndex(qindex);
+		qpadding = quotePadding(quote);
+		qpadding.setTop(0);
+		lineIndex = paragraph.lineIndex;
+		from += paragraph.blockIndex;
+		initNextParagraph(from, paragraph.paragraphQuoteIndex);
+	} else if ((*_blocks.cbegin())->type() != TextBlockType::Newline) {
 		initNextParagraph(_blocks.cbegin(), _startQuoteIndex);
 	}
 
@@ -964,7 +1254,7 @@ void String::enumerateLines(
 	auto last_rBearing = QFixed();
 	auto last_rPadding = QFixed();
 	bool longWordLine = true;
-	for (auto i = _blocks.cbegin(); i != _blocks.cend(); ++i) {
+	for (auto i = from; i != _blocks.cend(); ++i) {
 		const auto &b = *i;
 		auto _btype = b->type();
 		const auto blockHeight = CountBlockHeight(b.get(), _st);
@@ -994,6 +1284,7 @@ void String::enumerateLines(
 		auto b__f_rbearing = b->f_rbearing();
 		auto newWidthLeft = widthLeft - last_rBearing - (last_rPadding + b->f_width() - b__f_rbearing);
 		if (newWidthLeft >= 0) {
+			fitted(newWidthLeft);
 			last_rBearing = b__f_rbearing;
 			last_rPadding = b->f_rpadding();
 			widthLeft = newWidthLeft;
@@ -1005,8 +1296,8 @@ void String::enumerateLines(
 		}
 
 		if (_btype == TextBlockType::Text) {
-			const auto t = &b.unsafe<TextBlock>();
-			if (t->_words.isEmpty()) { // no words in this block, spaces only => layout this block in the same line
+			const auto words = this->words(&b.unsafe<TextBlock>());
+			if (words.empty()) { // no words in this block, spaces only => layout this block in the same line
 				last_rPadding += b->f_rpadding();
 
 				lineHeight = qMax(lineHeight, blockHeight);
@@ -1017,12 +1308,13 @@ void String::enumerateLines(
 
 			auto f_wLeft = widthLeft;
 			int f_lineHeight = lineHeight;
-			for (auto j = t->_words.cbegin(), e = t->_words.cend(), f = j; j != e; ++j) {
+			for (auto j = words.begin(), e = words.end(), f = j; j != e; ++j) {
 				bool wordEndsHere = (j->f_width() >= 0);
 				auto j_width = wordEndsHere ? j->f_width() : -j->f_width();
 
 				auto newWidthLeft = widthLeft - last_rBearing - (last_rPadding + j_width - j->f_rbearing());
 				if (newWidthLeft >= 0) {
+					fitted(newWidthLeft);
 					last_rBearing = j->f_rbearing();
 					last_rPadding = j->f_rpadding();
 					widthLeft = newWidthLeft;
@@ -1093,6 +1385,7 @@ void String::enumerateLines(
 			lineLeft + lineWidth - widthLeft,
 			top + lineHeight + qpadding.bottom());
 	}
+	finishParagraph();
 	return withElided(false);
 }
 
@@ -1198,7 +1491,7 @@ StateResult String::getStateElidedLeft(QPoint point, int width, int outerw, Stat
 }
 
 TextSelection String::adjustSelection(TextSelection selection, TextSelectType selectType) const {
-	uint16 from = selection.from, to = selection.to;
+	auto from = selection.from, to = selection.to;
 	if (from < _text.size() && from <= to) {
 		if (to > _text.size()) to = _text.size();
 		if (selectType == TextSelectType::Paragraphs) {
@@ -1277,13 +1570,20 @@ not_null<ExtendedData*> String::ensureExtended() {
 	return _extended.get();
 }
 
-uint16 String::countBlockEnd(
+gsl::span<const TextWord> String::words(
+		not_null<const TextBlock*> block) const {
+	return gsl::make_span(_words).subspan(
+		block->wordsFrom(),
+		block->wordsCount());
+}
+
+int String::countBlockEnd(
 		const TextBlocks::const_iterator &i,
 		const TextBlocks::const_iterator &e) const {
 	return (i + 1 == e) ? _text.size() : (*(i + 1))->position();
 }
 
-uint16 String::countBlockLength(
+int String::countBlockLength(
 		const TextBlocks::const_iterator &i,
 		const TextBlocks::const_iterator &e) const {
 	return countBlockEnd(i, e) - (*i)->position();
@@ -1375,13 +1675,13 @@ void String::enumerateText(
 	}
 
 	int linkIndex = 0;
-	uint16 linkPosition = 0;
+	int linkPosition = 0;
 	int quoteIndex = _startQuoteIndex;
 
 	TextBlockFlags flags = {};
 	for (auto i = _blocks.cbegin(), e = _blocks.cend(); true; ++i) {
 		const auto blockPosition = (i == e)
-			? uint16(_text.size())
+			? int(_text.size())
 			: (*i)->position();
 		const auto blockFlags = (i == e) ? TextBlockFlags() : (*i)->flags();
 		const auto blockQuoteIndex = (i == e)
@@ -1458,7 +1758,7 @@ void String::enumerateText(
 		auto rangeFrom = qMax(selection.from, blockPosition);
 		auto rangeTo = qMin(
 			selection.to,
-			uint16(blockPosition + countBlockLength(i, e)));
+			blockPosition + countBlockLength(i, e));
 		if (rangeTo > rangeFrom) {
 			const auto customEmojiData = (blockType == TextBlockType::CustomEmoji)
 				? static_cast<const CustomEmojiBlock*>(i->get())->_custom->entityData()
@@ -1718,7 +2018,10 @@ IsolatedEmoji String::toIsolatedEmoji() const {
 void String::clear() {
 	_text.clear();
 	_blocks.clear();
+	_words.clear();
 	_extended = nullptr;
+	_lineBreaks = nullptr;
+	_drawLineBreaks = nullptr;
 	_maxWidth = _minHeight = 0;
 	_startQuoteIndex = 0;
 	_startParagraphLTR = false;
@@ -1726,6 +2029,9 @@ void String::clear() {
 }
 
 bool IsBad(QChar ch) {
+	if (ch > 0 && ch < 127) {
+		return false;
+	}
 	return (ch == 0)
 		|| (ch >= 8232 && ch < 8237)
 		|| (ch >= 65024 && ch < 65040 && ch != 65039)
@@ -1806,6 +2112,9 @@ bool IsNewline(QChar ch) {
 }
 
 bool IsSpace(QChar ch) {
+	if (ch > 32 && ch < 127) {
+		return false;
+	}
 	return ch.isSpace()
 		|| (ch < 32)
 		|| (ch == QChar::ParagraphSeparator)
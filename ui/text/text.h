@@ -53,15 +53,18 @@ enum class TextSelectType {
 	Paragraphs = 0x03,
 };
 
+// Leaves room for shifting a selection by a text length without overflow.
+inline constexpr auto kMaxTextSelectionPosition = 0x3FFFFFFF;
+
 struct TextSelection {
 	constexpr TextSelection() = default;
-	constexpr TextSelection(uint16 from, uint16 to) : from(from), to(to) {
+	constexpr TextSelection(int from, int to) : from(from), to(to) {
 	}
 	constexpr bool empty() const {
 		return from == to;
 	}
-	uint16 from = 0;
-	uint16 to = 0;
+	int from = 0;
+	int to = 0;
 };
 
 inline bool operator==(TextSelection a, TextSelection b) {
@@ -72,12 +75,18 @@ inline bool operator!=(TextSelection a, TextSelection b) {
 	return !(a == b);
 }
 
-static constexpr TextSelection AllTextSelection = { 0, 0xFFFF };
+static constexpr TextSelection AllTextSelection = {
+	0,
+	kMaxTextSelectionPosition,
+};
 
 namespace Ui::Text {
 
 class Block;
 class AbstractBlock;
+class TextBlock;
+class DetachedFonts;
+class TextWord;
 struct IsolatedEmoji;
 struct OnlyCustomEmoji;
 struct SpoilerData;
@@ -86,7 +95,7 @@ struct ExtendedData;
 
 struct Modification {
 	int position = 0;
-	uint16 skipped = 0;
+	int skipped = 0;
 	bool added = false;
 };
 
@@ -111,7 +120,7 @@ struct StateResult {
 	ClickHandlerPtr link;
 	bool uponSymbol = false;
 	bool afterSymbol = false;
-	uint16 symbol = 0;
+	int symbol = 0;
 };
 
 struct StateRequestElided : StateRequest {
@@ -153,6 +162,7 @@ struct GeometryDescriptor {
 	Fn<LineGeometry(int line)> layout;
 	bool breakEverywhere = false;
 	bool *outElided = nullptr;
+	int uniformWidth = 0; // All lines have this width and are not elided.
 };
 
 [[nodiscard]] not_null<SpoilerMessCache*> DefaultSpoilerCache();
@@ -251,6 +261,16 @@ public:
 	String &operator=(String &&other);
 	~String();
 
+	// Parses the text on the main thread, shapes and measures it on
+	// a background thread and passes the result to done() on main.
+	static void PrepareMarkedTextAsync(
+		const style::TextStyle &st,
+		const TextWithEntities &textWithEntities,
+		Fn<void(String&&)> done,
+		const TextParseOptions &options = kMarkupTextOptions,
+		int minResizeWidth = kQFixedMax,
+		const std::any &context = {});
+
 	[[nodiscard]] int countWidth(
 		int width,
 		bool breakEverywhere = false) const;
@@ -363,6 +383,7 @@ public:
 
 private:
 	using TextBlocks = std::vector<Block>;
+	using TextWords = std::vector<TextWord>;
 
 	class ExtendedWrap : public std::unique_ptr<ExtendedData> {
 	public:
@@ -382,11 +403,13 @@ private:
 	};
 
 	[[nodiscard]] not_null<ExtendedData*> ensureExtended();
+	[[nodiscard]] gsl::span<const TextWord> words(
+		not_null<const TextBlock*> block) const;
 
-	[[nodiscard]] uint16 countBlockEnd(
+	[[nodiscard]] int countBlockEnd(
 		const TextBlocks::const_iterator &i,
 		const TextBlocks::const_iterator &e) const;
-	[[nodiscard]] uint16 countBlockLength(
+	[[nodiscard]] int countBlockLength(
 		const TextBlocks::const_iterator &i,
 		const TextBlocks::const_iterator &e) const;
 	[[nodiscard]] QuoteDetails *quoteByIndex(int index) const;
@@ -425,8 +448,33 @@ private:
 		GeometryDescriptor geometry,
 		Callback &&callback) const;
 
+	// If record is not nullptr the layout resumes from the last recorded
+	// paragraph and records paragraph checkpoints while enumerating.
+	struct LineBreaksCache;
+	template <typename Callback>
+	void enumerateLines(
+		GeometryDescriptor geometry,
+		LineBreaksCache *record,
+		Callback &&callback) const;
+	const LineBreaksCache &validateLineBreaks(
+		std::unique_ptr<LineBreaksCache> &record,
+		int width,
+		bool breakEverywhere) const;
+
 	void insertModifications(int position, int delta);
 	void removeModificationsAfter(int size);
+	struct ParagraphStart {
+		int blockIndex = 0;
+		int lineIndex = 0;
+		int top = 0;
+	};
+	[[nodiscard]] ParagraphStart findParagraphAbove(
+		int width,
+		bool breakEverywhere,
+		int top) const;
+
+	[[nodiscard]] DetachedFonts detachTextBlockFonts() const;
+	void measureTextBlocks(const DetachedFonts *detached = nullptr);
 	void recountNaturalSize(
 		bool initial,
 		Qt::LayoutDirection optionsDir = Qt::LayoutDirectionAuto);
@@ -439,7 +487,10 @@ private:
 	const style::TextStyle *_st = nullptr;
 	QString _text;
 	TextBlocks _blocks;
+	TextWords _words; // Words of all text blocks, in order.
 	ExtendedWrap _extended;
+	mutable std::unique_ptr<LineBreaksCache> _lineBreaks;
+	mutable std::unique_ptr<LineBreaksCache> _drawLineBreaks;
 
 	int _minResizeWidth = 0;
 	int _maxWidth = 0;
@@ -456,6 +507,7 @@ private:
 
 	friend class Parser;
 	friend class Renderer;
+	friend class BatchBuilder;
 
 };
 
@@ -472,13 +524,16 @@ private:
 } // namespace Ui::Text
 
 inline TextSelection snapSelection(int from, int to) {
-	return { static_cast<uint16>(std::clamp(from, 0, 0xFFFF)), static_cast<uint16>(std::clamp(to, 0, 0xFFFF)) };
+	return {
+		std::clamp(from, 0, kMaxTextSelectionPosition),
+		std::clamp(to, 0, kMaxTextSelectionPosition),
+	};
 }
-inline TextSelection shiftSelection(TextSelection selection, uint16 byLength) {
-	return snapSelection(int(selection.from) + byLength, int(selection.to) + byLength);
+inline TextSelection shiftSelection(TextSelection selection, int byLength) {
+	return snapSelection(selection.from + byLength, selection.to + byLength);
 }
-inline TextSelection unshiftSelection(TextSelection selection, uint16 byLength) {
-	return snapSelection(int(selection.from) - int(byLength), int(selection.to) - int(byLength));
+inline TextSelection unshiftSelection(TextSelection selection, int byLength) {
+	return snapSelection(selection.from - byLength, selection.to - byLength);
 }
 inline TextSelection shiftSelection(TextSelection selection, const Ui::Text::String &byText) {
 	return shiftSelection(selection, byText.length());
@@ -0,0 +1,43 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#include "ui/text/text_batch.h"
+
+#include "ui/text/text_block.h"
+#include "ui/text/text_parser.h"
+
+namespace Ui::Text {
+
+BatchBuilder::BatchBuilder(
+	const style::TextStyle &st,
+	int minResizeWidth)
+: _st(&st)
+, _minResizeWidth(minResizeWidth)
+, _cache(std::make_unique<TextBlockMeasureCache>()) {
+}
+
+BatchBuilder::~BatchBuilder() = default;
+
+String BatchBuilder::build(
+		const TextWithEntities &textWithEntities,
+		const TextParseOptions &options,
+		const std::any &context) {
+	auto result = String(_minResizeWidth);
+	result._st = _st;
+	{
+		Parser parser(
+			&result,
+			textWithEntities,
+			options,
+			context,
+			true,
+			_cache.get());
+	}
+	result.recountNaturalSize(true, options.dir);
+	return result;
+}
+
+} // namespace Ui::Text
@@ -0,0 +1,36 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#pragma once
+
+#include "ui/text/text.h"
+
+namespace Ui::Text {
+
+class TextBlockMeasureCache;
+
+// Builds many Strings with the same style, reusing the shaped words
+// of the text blocks they have in common.
+class BatchBuilder final {
+public:
+	explicit BatchBuilder(
+		const style::TextStyle &st,
+		int minResizeWidth = kQFixedMax);
+	~BatchBuilder();
+
+	[[nodiscard]] String build(
+		const TextWithEntities &textWithEntities,
+		const TextParseOptions &options = kMarkupTextOptions,
+		const std::any &context = {});
+
+private:
+	const not_null<const style::TextStyle*> _st;
+	const int _minResizeWidth = 0;
+	const std::unique_ptr<TextBlockMeasureCache> _cache;
+
+};
+
+} // namespace Ui::Text
@@ -16,6 +16,9 @@ namespace Ui {
 namespace Text {
 namespace {
 
+constexpr auto kMaxCachedTextBlockLength = 128;
+constexpr auto kMaxCachedTextBlocks = 4096;
+
 struct ScriptLine {
 	int length = 0;
 	QFixed textWidth;
@@ -159,19 +162,38 @@ void addNextCluster(
 	++glyphCount;
 }
 
+[[nodiscard]] QFont DetachedCopy(const QFont &font) {
+	// A newly built QFont owns a fresh QFontPrivate, so nothing of the
+	// lazily filled engine data of the original is shared with it.
+	auto result = QFont(font.family());
+	result.setPixelSize(font.pixelSize());
+	result.setWeight(font.weight());
+	result.setItalic(font.italic());
+	result.setUnderline(font.underline());
+	result.setStrikeOut(font.strikeOut());
+	result.setStyleStrategy(font.styleStrategy());
+	result.setHintingPreference(font.hintingPreference());
+#if QT_VERSION >= QT_VERSION_CHECK(6, 7, 0)
+	for (const auto &tag : font.featureTags()) {
+		result.setFeature(tag, font.featureValue(tag));
+	}
+#endif // Qt >= 6.7.0
+	return result;
+}
+
 } // anonymous namespace
 
 class BlockParser {
 public:
 	BlockParser(
 		TextBlock &block,
+		std::vector<TextWord> &words,
 		QTextEngine &engine,
 		QFixed minResizeWidth,
-		int blockPosition,
 		const QString &text);
 
 private:
-	void parseWords(QFixed minResizeWidth, int blockFrom);
+	void parseWords(QFixed minResizeWidth);
 	[[nodiscard]] bool isLineBreak(
 		const QCharAttributes *attributes,
 		int index) const;
@@ -180,6 +202,8 @@ private:
 		int index) const;
 
 	TextBlock &block;
+	std::vector<TextWord> &words;
+	const int wordsFrom = 0;
 	QTextEngine &engine;
 	const QString &text;
 
@@ -187,17 +211,19 @@ private:
 
 BlockParser::BlockParser(
 	TextBlock &block,
+	std::vector<TextWord> &words,
 	QTextEngine &engine,
 	QFixed minResizeWidth,
-	int blockFrom,
 	const QString &text)
 : block(block)
+, words(words)
+, wordsFrom(int(words.size()))
 , engine(engine)
 , text(text) {
-	parseWords(minResizeWidth, blockFrom);
+	parseWords(minResizeWidth);
 }
 
-void BlockParser::parseWords(QFixed minResizeWidth, int blockFrom) {
+void BlockParser::parseWords(QFixed minResizeWidth) {
 	LineBreakHelper lbh;
 
 	// Helper for debugging crashes in text processing.
@@ -221,8 +247,6 @@ void BlockParser::parseWords(QFixed minResizeWidth, int blockFrom) {
 	int end = 0;
 	lbh.logClusters = engine.layoutData->logClustersPtr;
 
-	block._words.clear();
-
 	int wordStart = lbh.currentPosition;
 
 	bool addingEachGrapheme = false;
@@ -272,13 +296,13 @@ void BlockParser::parseWords(QFixed minResizeWidth, int blockFrom) {
 					lbh.logClusters,
 					lbh.glyphs);
 
-			if (block._words.isEmpty()) {
-				block._words.push_back(TextWord(
-					wordStart + blockFrom,
+			if (int(words.size()) == wordsFrom) {
+				words.push_back(TextWord(
+					wordStart,
 					lbh.tmpData.textWidth,
 					-lbh.negativeRightBearing()));
 			}
-			block._words.back().add_rpadding(lbh.spaceData.textWidth);
+			words.back().add_rpadding(lbh.spaceData.textWidth);
 			block._width += lbh.spaceData.textWidth;
 			lbh.spaceData.length = 0;
 			lbh.spaceData.textWidth = 0;
@@ -303,8 +327,8 @@ void BlockParser::parseWords(QFixed minResizeWidth, int blockFrom) {
 					|| isSpaceBreak(attributes, lbh.currentPosition)
 					|| isLineBreak(attributes, lbh.currentPosition)) {
 					lbh.calculateRightBearing();
-					block._words.push_back(TextWord(
-						wordStart + blockFrom,
+					words.push_back(TextWord(
+						wordStart,
 						lbh.tmpData.textWidth,
 						-lbh.negativeRightBearing()));
 					block._width += lbh.tmpData.textWidth;
@@ -316,8 +340,8 @@ void BlockParser::parseWords(QFixed minResizeWidth, int blockFrom) {
 					if (!addingEachGrapheme && lbh.tmpData.textWidth > minResizeWidth) {
 						if (lastGraphemeBoundaryPosition >= 0) {
 							lbh.calculateRightBearingForPreviousGlyph();
-							block._words.push_back(TextWord(
-								wordStart + blockFrom,
+							words.push_back(TextWord(
+								wordStart,
 								-lastGraphemeBoundaryLine.textWidth,
 								-lbh.negativeRightBearing()));
 							block._width += lastGraphemeBoundaryLine.textWidth;
@@ -329,8 +353,8 @@ void BlockParser::parseWords(QFixed minResizeWidth, int blockFrom) {
 					}
 					if (addingEachGrapheme) {
 						lbh.calculateRightBearing();
-						block._words.push_back(TextWord(
-							wordStart + blockFrom,
+						words.push_back(TextWord(
+							wordStart,
 							-lbh.tmpData.textWidth,
 							-lbh.negativeRightBearing()));
 						block._width += lbh.tmpData.textWidth;
@@ -348,10 +372,9 @@ void BlockParser::parseWords(QFixed minResizeWidth, int blockFrom) {
 		if (lbh.currentPosition == end)
 			newItem = item + 1;
 	}
-	if (!block._words.isEmpty()) {
-		block._rpadding = block._words.back().f_rpadding();
+	if (int(words.size()) > wordsFrom) {
+		block._rpadding = words.back().f_rpadding();
 		block._width -= block._rpadding;
-		block._words.squeeze();
 	}
 }
 
@@ -406,6 +429,72 @@ style::font WithFlags(
 	return result;
 }
 
+style::FontFlags WithFlags(
+		style::FontFlags fontFlags,
+		TextBlockFlags flags) {
+	using Flag = style::FontFlag;
+	if (!flags) {
+		return fontFlags;
+	} else if (IsMono(flags)) {
+		return fontFlags | Flag::Monospace;
+	}
+	auto result = fontFlags;
+	if (flags & TextBlockFlag::Bold) {
+		result |= Flag::Bold;
+	} else if (flags & TextBlockFlag::Semibold) {
+		result |= Flag::Semibold;
+	}
+	if (flags & TextBlockFlag::Italic) {
+		result |= Flag::Italic;
+	}
+	if (flags & TextBlockFlag::Underline) {
+		result |= Flag::Underline;
+	}
+	if (flags & TextBlockFlag::StrikeOut) {
+		result |= Flag::StrikeOut;
+	}
+	if (flags & TextBlockFlag::Tilde) { // Tilde fix in OpenSans.
+		result |= Flag::Semibold;
+	}
+	return result;
+}
+
+DetachedFonts::DetachedFonts()
+: _fallback(DetachedCopy(QFont())) {
+}
+
+void DetachedFonts::add(const style::font &font) {
+	const auto key = font->flags().value();
+	if (_fonts.contains(key)) {
+		return;
+	}
+	_fonts.emplace(key, DetachedCopy(font->f));
+}
+
+const QFont &DetachedFonts::font(style::FontFlags flags) const {
+	const auto key = flags.value();
+	if (const auto i = _fonts.find(key); i != end(_fonts)) {
+		return i->second;
+	}
+	// Measure with the font that differs in the fewest flags.
+	const auto distance = [&](int other) {
+		auto result = 0;
+		for (auto bits = (key ^ other); bits; bits &= (bits - 1)) {
+			++result;
+		}
+		return result;
+	};
+	auto result = &_fallback;
+	auto best = std::numeric_limits<int>::max();
+	for (const auto &[other, font] : _fonts) {
+		if (const auto now = distance(other); now < best) {
+			best = now;
+			result = &font;
+		}
+	}
+	return *result;
+}
+
 Qt::LayoutDirection UnpackParagraphDirection(bool ltr, bool rtl) {
 	return ltr
 		? Qt::LeftToRight
@@ -417,8 +506,8 @@ Qt::LayoutDirection UnpackParagraphDirection(bool ltr, bool rtl) {
 AbstractBlock::AbstractBlock(
 	const style::font &font,
 	const QString &text,
-	uint16 position,
-	uint16 length,
+	int position,
+	int length,
 	TextBlockType type,
 	uint16 flags,
 	uint16 linkIndex,
@@ -430,7 +519,7 @@ AbstractBlock::AbstractBlock(
 , _colorIndex(colorIndex) {
 }
 
-uint16 AbstractBlock::position() const {
+int AbstractBlock::position() const {
 	return _position;
 }
 
@@ -471,12 +560,11 @@ QFixed AbstractBlock::f_rbearing() const {
 TextBlock::TextBlock(
 	const style::font &font,
 	const QString &text,
-	uint16 position,
-	uint16 length,
+	int position,
+	int length,
 	TextBlockFlags flags,
 	uint16 linkIndex,
-	uint16 colorIndex,
-	QFixed minResizeWidth)
+	uint16 colorIndex)
 : AbstractBlock(
 		font,
 		text,
@@ -486,29 +574,111 @@ TextBlock::TextBlock(
 		flags,
 		linkIndex,
 		colorIndex) {
+	Expects(length <= kMaxTextBlockLength);
+}
+
+void TextBlock::measure(
+		const style::font &font,
+		const QString &text,
+		int length,
+		QFixed minResizeWidth,
+		std::vector<TextWord> &words,
+		TextBlockMeasureCache *cache,
+		const DetachedFonts *detached) {
+	_wordsFrom = int(words.size());
 	if (!length) {
 		return;
 	}
-	const auto blockFont = WithFlags(font, flags);
-	if (!flags && linkIndex) {
-		// should use TextStyle lnkFlags somehow... not supported
+	const auto part = text.mid(_position, length);
+	if (detached) {
+		// Off main the style font registry is not touched at all.
+		QStackTextEngine engine(
+			part,
+			detached->font(WithFlags(font->flags(), flags())));
+		BlockParser parser(*this, words, engine, minResizeWidth, part);
+	} else {
+		const auto blockFont = WithFlags(font, flags());
+		if (!flags() && linkIndex()) {
+			// should use TextStyle lnkFlags somehow... not supported
+		}
+		if (!TextBlockMeasureCache::Cacheable(length)) {
+			cache = nullptr;
+		}
+		if (const auto cached = cache
+				? cache->find(blockFont, minResizeWidth, part)
+				: nullptr) {
+			words.insert(
+				end(words),
+				begin(cached->words),
+				end(cached->words));
+			_width = cached->width;
+			_rpadding = cached->rpadding;
+		} else {
+			QStackTextEngine engine(part, blockFont->f);
+			BlockParser parser(*this, words, engine, minResizeWidth, part);
+			if (cache) {
+				cache->insert(blockFont, minResizeWidth, part, {
+					.words = { begin(words) + _wordsFrom, end(words) },
+					.width = _width,
+					.rpadding = _rpadding,
+				});
+			}
+		}
 	}
+	_wordsCount = int(words.size()) - _wordsFrom;
+	if (_wordsCount) {
+		_rbearing = words.back().f_rbearing();
+	}
+}
 
-	const auto part = text.mid(_position, length);
+bool TextBlockMeasureCache::Cacheable(int length) {
+	return (length <= kMaxCachedTextBlockLength);
+}
 
-	QStackTextEngine engine(part, blockFont->f);
-	BlockParser parser(*this, engine, minResizeWidth, _position, part);
+auto TextBlockMeasureCache::find(
+		const style::font &font,
+		QFixed minResizeWidth,
+		const QString &text) const -> const Entry* {
+	const auto i = _entries.find({ font.get(), minResizeWidth.value(), text });
+	return (i != end(_entries)) ? &i->second : nullptr;
+}
+
+void TextBlockMeasureCache::insert(
+		const style::font &font,
+		QFixed minResizeWidth,
+		const QString &text,
+		Entry entry) {
+	if (_entries.size() >= kMaxCachedTextBlocks) {
+		_entries.clear();
+	}
+	_entries.emplace(
+		Key{ font.get(), minResizeWidth.value(), text },
+		std::move(entry));
+}
+
+size_t TextBlockMeasureCache::KeyHash::operator()(const Key &key) const {
+	return qHash(key.text)
+		^ std::hash<void*>()(key.font)
+		^ size_t(key.minResizeWidth);
+}
+
+int TextBlock::wordsFrom() const {
+	return _wordsFrom;
+}
+
+int TextBlock::wordsCount() const {
+	return _wordsCount;
 }
 
 QFixed TextBlock::real_f_rbearing() const {
-	return _words.isEmpty() ? 0 : _words.back().f_rbearing();
+	return _rbearing;
 }
 
 EmojiBlock::EmojiBlock(
 	const style::font &font,
 	const QString &text,
-	uint16 position,
-	uint16 length,
+	int position,
+	int length,
 	TextBlockFlags flags,
 	uint16 linkIndex,
 	uint16 colorIndex,
@@ -538,8 +708,8 @@ EmojiBlock::EmojiBlock(
 CustomEmojiBlock::CustomEmojiBlock(
 	const style::font &font,
 	const QString &text,
-	uint16 position,
-	uint16 length,
+	int position,
+	int length,
 	TextBlockFlags flags,
 	uint16 linkIndex,
 	uint16 colorIndex,
@@ -569,8 +739,8 @@ CustomEmojiBlock::CustomEmojiBlock(
 NewlineBlock::NewlineBlock(
 	const style::font &font,
 	const QString &text,
-	uint16 position,
-	uint16 length,
+	int position,
+	int length,
 	TextBlockFlags flags,
 	uint16 linkIndex,
 	uint16 colorIndex)
@@ -588,7 +758,7 @@ NewlineBlock::NewlineBlock(
 SkipBlock::SkipBlock(
 	const style::font &font,
 	const QString &text,
-	uint16 position,
+	int position,
 	int32 width,
 	int32 height,
 	uint16 linkIndex,
@@ -612,11 +782,11 @@ int SkipBlock::height() const {
 
 
 TextWord::TextWord(
-	uint16 position,
+	uint16 offset,
 	QFixed width,
 	QFixed rbearing,
 	QFixed rpadding)
-: _position(position)
+: _offset(offset)
 , _rbearing((rbearing.value() > 0x7FFF)
 	? 0x7FFF
 	: (rbearing.value() < -0x7FFF ? -0x7FFF : rbearing.value()))
@@ -624,8 +794,8 @@ TextWord::TextWord(
 , _rpadding(rpadding) {
 }
 
-uint16 TextWord::position() const {
-	return _position;
+uint16 TextWord::offset() const {
+	return _offset;
 }
 
 QFixed TextWord::f_rbearing() const {
@@ -706,8 +876,8 @@ Block::~Block() {
 Block Block::Newline(
 		const style::font &font,
 		const QString &text,
-		uint16 position,
-		uint16 length,
+		int position,
+		int length,
 		TextBlockFlags flags,
 		uint16 linkIndex,
 		uint16 colorIndex) {
@@ -724,12 +894,11 @@ Block Block::Newline(
 Block Block::Text(
 		const style::font &font,
 		const QString &text,
-		uint16 position,
-		uint16 length,
+		int position,
+		int length,
 		TextBlockFlags flags,
 		uint16 linkIndex,
-		uint16 colorIndex,
-		QFixed minResizeWidth) {
+		uint16 colorIndex) {
 	return New<TextBlock>(
 		font,
 		text,
@@ -737,15 +906,14 @@ Block Block::Text(
 		length,
 		flags,
 		linkIndex,
-		colorIndex,
-		minResizeWidth);
+		colorIndex);
 }
 
 Block Block::Emoji(
 		const style::font &font,
 		const QString &text,
-		uint16 position,
-		uint16 length,
+		int position,
+		int length,
 		TextBlockFlags flags,
 		uint16 linkIndex,
 		uint16 colorIndex,
@@ -764,8 +932,8 @@ Block Block::Emoji(
 Block Block::CustomEmoji(
 		const style::font &font,
 		const QString &text,
-		uint16 position,
-		uint16 length,
+		int position,
+		int length,
 		TextBlockFlags flags,
 		uint16 linkIndex,
 		uint16 colorIndex,
@@ -784,7 +952,7 @@ Block Block::CustomEmoji(
 Block Block::Skip(
 		const style::font &font,
 		const QString &text,
-		uint16 position,
+		int position,
 		int32 width,
 		int32 height,
 		uint16 linkIndex,
@@ -15,6 +15,8 @@
 
 #include <private/qfixed_p.h>
 
+#include <unordered_map>
+
 namespace style {
 struct TextStyle;
 } // namespace style
@@ -49,13 +51,38 @@ using TextBlockFlags = base::flags<TextBlockFlag>;
 	TextBlockFlags flags,
 	style::FontFlags fontFlags = 0);
 
+// Flags of the WithFlags(font, flags) result, computed without the fonts.
+[[nodiscard]] style::FontFlags WithFlags(
+	style::FontFlags fontFlags,
+	TextBlockFlags flags);
+
+// QFont copies that share no private data with the style registry fonts.
+// Prepared on main for shaping text blocks on another thread.
+class DetachedFonts final {
+public:
+	DetachedFonts();
+
+	void add(const style::font &font);
+
+	// Falls back to the closest added font, never fails.
+	[[nodiscard]] const QFont &font(style::FontFlags flags) const;
+
+private:
+	base::flat_map<int, QFont> _fonts;
+	QFont _fallback;
+
+};
+
 [[nodiscard]] Qt::LayoutDirection UnpackParagraphDirection(
 	bool ltr,
 	bool rtl);
 
+// Text blocks are split by the parser so that word offsets fit in 16 bits.
+inline constexpr auto kMaxTextBlockLength = 0xFFFF;
+
 class AbstractBlock {
 public:
-	[[nodiscard]] uint16 position() const;
+	[[nodiscard]] int position() const;
 	[[nodiscard]] TextBlockType type() const;
 	[[nodiscard]] TextBlockFlags flags() const;
 	[[nodiscard]] uint16 colorIndex() const;
@@ -72,14 +99,14 @@ protected:
 	AbstractBlock(
 		const style::font &font,
 		const QString &text,
-		uint16 position,
-		uint16 length,
+		int position,
+		int length,
 		TextBlockType type,
 		uint16 flags,
 		uint16 linkIndex,
 		uint16 colorIndex);
 
-	uint16 _position = 0;
+	int _position = 0;
 	uint16 _type : 4 = 0;
 	uint16 _flags : 12 = 0;
 	uint16 _linkIndex = 0;
@@ -101,8 +128,8 @@ public:
 	NewlineBlock(
 		const style::font &font,
 		const QString &str,
-		uint16 position,
-		uint16 length,
+		int position,
+		int length,
 		TextBlockFlags flags,
 		uint16 linkIndex,
 		uint16 colorIndex);
@@ -129,12 +156,13 @@ class TextWord final {
 public:
 	TextWord() = default;
 	TextWord(
-		uint16 position,
+		uint16 offset,
 		QFixed width,
 		QFixed rbearing,
 		QFixed rpadding = 0);
 
-	[[nodiscard]] uint16 position() const;
+	// Relative to the position of the owning TextBlock.
+	[[nodiscard]] uint16 offset() const;
 	[[nodiscard]] QFixed f_rbearing() const;
 	[[nodiscard]] QFixed f_width() const;
 	[[nodiscard]] QFixed f_rpadding() const;
@@ -142,29 +170,84 @@ public:
 	void add_rpadding(QFixed padding);
 
 private:
-	uint16 _position = 0;
+	uint16 _offset = 0;
 	int16 _rbearing = 0;
 	QFixed _width;
 	QFixed _rpadding;
 
 };
 
+// Shaped words of short text blocks, shared between several Strings.
+class TextBlockMeasureCache final {
+public:
+	struct Entry {
+		std::vector<TextWord> words;
+		QFixed width;
+		QFixed rpadding;
+	};
+
+	[[nodiscard]] static bool Cacheable(int length);
+
+	[[nodiscard]] const Entry *find(
+		const style::font &font,
+		QFixed minResizeWidth,
+		const QString &text) const;
+	void insert(
+		const style::font &font,
+		QFixed minResizeWidth,
+		const QString &text,
+		Entry entry);
+
+private:
+	struct Key {
+		style::internal::FontData *font = nullptr;
+		int minResizeWidth = 0;
+		QString text;
+
+		friend inline bool operator==(
+			const Key &a,
+			const Key &b) = default;
+	};
+	struct KeyHash {
+		[[nodiscard]] size_t operator()(const Key &key) const;
+	};
+
+	std::unordered_map<Key, Entry, KeyHash> _entries;
+
+};
+
 class TextBlock final : public AbstractBlock {
 public:
 	TextBlock(
 		const style::font &font,
 		const QString &text,
-		uint16 position,
-		uint16 length,
+		int position,
+		int length,
 		TextBlockFlags flags,
 		uint16 linkIndex,
-		uint16 colorIndex,
-		QFixed minResizeWidth);
+		uint16 colorIndex);
+
+	// Shapes the block and appends its words.
+	// Off main it should be called with the detached fonts.
+	void measure(
+		const style::font &font,
+		const QString &text,
+		int length,
+		QFixed minResizeWidth,
+		std::vector<TextWord> &words,
+		TextBlockMeasureCache *cache = nullptr,
+		const DetachedFonts *detached = nullptr);
+
+	[[nodiscard]] int wordsFrom() const;
+	[[nodiscard]] int wordsCount() const;
 
 private:
 	[[nodiscard]] QFixed real_f_rbearing() const;
 
-	QVector<TextWord> _words;
+	// Words are appended to the String-wide array, see String::words().
+	int _wordsFrom = 0;
+	int _wordsCount = 0;
+	QFixed _rbearing = 0;
 
 	friend class String;
 	friend class Parser;
@@ -179,8 +262,8 @@ public:
 	EmojiBlock(
 		const style::font &font,
 		const QString &text,
-		uint16 position,
-		uint16 length,
+		int position,
+		int length,
 		TextBlockFlags flags,
 		uint16 linkIndex,
 		uint16 colorIndex,
@@ -200,8 +283,8 @@ public:
 	CustomEmojiBlock(
 		const style::font &font,
 		const QString &text,
-		uint16 position,
-		uint16 length,
+		int position,
+		int length,
 		TextBlockFlags flags,
 		uint16 linkIndex,
 		uint16 colorIndex,
@@ -221,7 +304,7 @@ public:
 	SkipBlock(
 		const style::font &font,
 		const QString &text,
-		uint16 position,
+		int position,
 		int32 width,
 		int32 height,
 		uint16 linkIndex,
@@ -248,8 +331,8 @@ public:
 	[[nodiscard]] static Block Newline(
 		const style::font &font,
 		const QString &text,
-		uint16 position,
-		uint16 length,
+		int position,
+		int length,
 		TextBlockFlags flags,
 		uint16 linkIndex,
 		uint16 colorIndex);
@@ -257,18 +340,17 @@ public:
 	[[nodiscard]] static Block Text(
 		const style::font &font,
 		const QString &text,
-		uint16 position,
-		uint16 length,
+		int position,
+		int length,
 		TextBlockFlags flags,
 		uint16 linkIndex,
-		uint16 colorIndex,
-		QFixed minResizeWidth);
+		uint16 colorIndex);
 
 	[[nodiscard]] static Block Emoji(
 		const style::font &font,
 		const QString &text,
-		uint16 position,
-		uint16 length,
+		int position,
+		int length,
 		TextBlockFlags flags,
 		uint16 linkIndex,
 		uint16 colorIndex,
@@ -277,8 +359,8 @@ public:
 	[[nodiscard]] static Block CustomEmoji(
 		const style::font &font,
 		const QString &text,
-		uint16 position,
-		uint16 length,
+		int position,
+		int length,
 		TextBlockFlags flags,
 		uint16 linkIndex,
 		uint16 colorIndex,
@@ -287,7 +369,7 @@ public:
 	[[nodiscard]] static Block Skip(
 		const style::font &font,
 		const QString &text,
-		uint16 position,
+		int position,
 		int32 width,
 		int32 height,
 		uint16 linkIndex,
@@ -16,10 +16,17 @@
 #include "base/qt/qt_common_adapters.h"
 
 #include <QtCore/QStack>
+#include <QtCore/qsimd.h>
 #include <QtCore/QMimeData>
 #include <QtGui/QGuiApplication>
 #include <QtGui/QClipboard>
 
+#if defined __SSE2__
+#include <emmintrin.h>
+#elif defined __ARM_NEON
+#include <arm_neon.h>
+#endif // __SSE2__ || __ARM_NEON
+
 namespace TextUtilities {
 namespace {
 
@@ -1141,11 +1148,6 @@ inline QChar RemoveOneAccent(uint32 code) {
 	return QChar(0);
 }
 
-const QRegularExpression &RegExpWordSplit() {
-	static const auto result = QRegularExpression(QString::fromLatin1("[\\@\\s\\-\\+\\(\\)\\[\\]\\{\\}\\<\\>\\,\\.\\:\\!\\_\\;\\\"\\'\\x0]"));
-	return result;
-}
-
 [[nodiscard]] QString ExpandCustomLinks(const TextWithTags &text) {
 	const auto entities = ConvertTextTagsToEntities(text.tags);
 	auto &&urls = ranges::make_subrange(
@@ -1209,6 +1211,239 @@ bool IsSentenceEnd(QChar ch) {
 		|| (ch == '!');
 }
 
+// Skips printable ASCII chars (0x20 - 0x7E), checking a vector at a time.
+[[nodiscard]] const QChar *SkipPlainAscii(
+		const QChar *from,
+		const QChar *till) {
+#if defined __SSE2__
+	const auto space = _mm_set1_epi16(0x20);
+	const auto tilde = _mm_set1_epi16(0x7E);
+	while (till - from >= 8) {
+		const auto chunk = _mm_loadu_si128(
+			reinterpret_cast<const __m128i*>(from));
+		const auto bad = _mm_or_si128(
+			_mm_cmplt_epi16(chunk, space), // < 0x20 or >= 0x8000
+			_mm_cmpgt_epi16(chunk, tilde)); // 0x7F - 0x7FFF
+		if (_mm_movemask_epi8(bad)) {
+			break;
+		}
+		from += 8;
+	}
+#elif defined __ARM_NEON
+	const auto space = vdupq_n_u16(0x20);
+	const auto tilde = vdupq_n_u16(0x7E);
+	while (till - from >= 8) {
+		const auto chunk = vld1q_u16(
+			reinterpret_cast<const uint16_t*>(from));
+		const auto bad = vorrq_u16(
+			vcltq_u16(chunk, space),
+			vcgtq_u16(chunk, tilde));
+		if (vget_lane_u64(vreinterpret_u64_u8(vmovn_u16(bad)), 0)) {
+			break;
+		}
+		from += 8;
+	}
+#else // __SSE2__ || __ARM_NEON
+	constexpr auto kHigh = 0xFF80FF80FF80FF80ULL;
+	constexpr auto kOne = 0x0001000100010001ULL;
+	constexpr auto kToSpace = 0x0060006000600060ULL;
+	constexpr auto kSign = 0x0080008000800080ULL;
+
+	while (till - from >= 4) {
+		auto chunk = uint64();
+		memcpy(&chunk, from, sizeof(chunk));
+		if ((chunk & kHigh) // >= 0x80
+			|| ((chunk + kOne) & kHigh) // == 0x7F
+			|| (((chunk + kToSpace) & kSign) != kSign)) { // < 0x20
+			break;
+		}
+		from += 4;
+	}
+#endif // __SSE2__ || __ARM_NEON
+	while (from != till && from->unicode() >= 0x20 && from->unicode() < 0x7F) {
+		++from;
+	}
+	return from;
+}
+
+// Remembers the last match of an expression while scanning forward.
+//
+// A search started anywhere between the previous search offset and
+// the previous match start finds that same match again, so it is
+// reused instead of rescanning the text for every found entity.
+class ForwardMatcher final {
+public:
+	explicit ForwardMatcher(const QRegularExpression &expression)
+	: _expression(expression) {
+	}
+
+	[[nodiscard]] const QRegularExpressionMatch &match(
+			const QString &text,
+			int offset) {
+		if (_offset < 0
+			|| offset < _offset
+			|| (_match.hasMatch() && offset > _match.capturedStart())) {
+			_match = _expression.match(text, offset);
+			_offset = offset;
+		}
+		return _match;
+	}
+
+private:
+	const QRegularExpression &_expression;
+	QRegularExpressionMatch _match;
+	int _offset = -1;
+
+};
+
+constexpr auto kCompactFormatVersion = uchar(1);
+
+// Varint writer for the compact tags and entities format.
+//
+// Offsets are stored as zigzag deltas from the previous offset and
+// repeated strings as one-based indices of their first occurrence.
+class CompactWriter final {
+public:
+	explicit CompactWriter(int count) {
+		_result.reserve(1 + count * 4);
+		_result.append(char(kCompactFormatVersion));
+		number(uint32(count));
+	}
+
+	void range(int offset, int length) {
+		const auto delta = offset - _offset;
+		number((uint32(delta) << 1) ^ uint32(delta >> 31));
+		number(uint32(length));
+		_offset = offset;
+	}
+	void byte(uchar value) {
+		_result.append(char(value));
+	}
+	void string(const QString &value) {
+		const auto i = _strings.find(value);
+		if (i != end(_strings)) {
+			number(uint32(i->second));
+			return;
+		}
+		_strings.emplace(value, int(_strings.size()) + 1);
+		const auto utf8 = value.toUtf8();
+		number(0);
+		number(uint32(utf8.size()));
+		_result.append(utf8);
+	}
+
+	[[nodiscard]] QByteArray result() {
+		return std::move(_result);
+	}
+
+private:
+	void number(uint32 value) {
+		while (value >= 0x80) {
+			_result.append(char((value & 0x7F) | 0x80));
+			value >>= 7;
+		}
+		_result.append(char(value));
+	}
+
+	QByteArray _result;
+	base::flat_map<QString, int> _strings;
+	int _offset = 0;
+
+};
+
+class CompactReader final {
+public:
+	CompactReader(const QByteArray &data, int textLength)
+	: _from(data.constData())
+	, _till(data.constData() + data.size())
+	, _textLength(textLength) {
+	}
+
+	[[nodiscard]] bool start(int &count) {
+		auto version = uchar();
+		auto value = uint32();
+		// Items may overlap, so their count is limited only by the data,
+		// each one takes at least two bytes for its offset and length.
+		if (!byte(version)
+			|| version != kCompactFormatVersion
+			|| !number(value)
+			|| value > uint32(_till - _from) / 2) {
+			return false;
+		}
+		count = int(value);
+		return true;
+	}
+	[[nodiscard]] bool range(int &offset, int &length) {
+		auto delta = uint32();
+		auto size = uint32();
+		if (!number(delta) || !number(size)) {
+			return false;
+		}
+		const auto shift = int64(int32((delta >> 1) ^ (0U - (delta & 1))));
+		const auto from = int64(_offset) + shift;
+		// Empty items are written as they are, so they are read back.
+		if (from < 0 || from + size > _textLength) {
+			return false;
+		}
+		_offset = offset = int(from);
+		length = int(size);
+		return true;
+	}
+	[[nodiscard]] bool byte(uchar &value) {
+		if (_from == _till) {
+			return false;
+		}
+		value = uchar(*_from++);
+		return true;
+	}
+	[[nodiscard]] bool string(QString &value) {
+		auto index = uint32();
+		if (!number(index)) {
+			return false;
+		} else if (index > 0) {
+			if (index > _strings.size()) {
+				return false;
+			}
+			value = _strings[index - 1];
+			return true;
+		}
+		auto size = uint32();
+		if (!number(size) || size > uint32(_till - _from)) {
+			return false;
+		}
+		value = QString::fromUtf8(_from, int(size));
+		_from += size;
+		_strings.push_back(value);
+		return true;
+	}
+	[[nodiscard]] bool finished() const {
+		return (_from == _till);
+	}
+
+private:
+	[[nodiscard]] bool number(uint32 &value) {
+		value = 0;
+		for (auto shift = 0; shift < 32; shift += 7) {
+			auto part = uchar();
+			if (!byte(part) || (shift == 28 && (part & 0x70))) {
+				return false;
+			}
+			value |= uint32(part & 0x7F) << shift;
+			if (!(part & 0x80)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	const char *_from = nullptr;
+	const char *_till = nullptr;
+	const int _textLength = 0;
+	int _offset = 0;
+	std::vector<QString> _strings;
+
+};
+
 } // namespace
 
 const QRegularExpression &RegExpMailNameAtEnd() {
@@ -1336,7 +1571,7 @@ QString SingleLine(const QString &text) {
 		result = text.mid(s - text.unicode(), e - s);
 	}
 
-	for (auto ch = s; ch != e; ++ch) {
+	for (auto ch = SkipPlainAscii(s, e); ch != e; ch = SkipPlainAscii(ch + 1, e)) {
 		if (IsNewline(*ch)/* || *ch == TextCommand*/) {
 			result[int(ch - s)] = QChar::Space;
 		}
@@ -1351,10 +1586,15 @@ TextWithEntities SingleLine(const TextWithEntities &text) {
 }
 
 QString RemoveAccents(const QString &text) {
+	const auto s = text.unicode(), e = s + text.size();
+	const auto plain = SkipPlainAscii(s, e);
+	if (plain == e) {
+		return text;
+	}
 	auto result = text;
 	auto copying = false;
-	auto i = 0;
-	for (auto s = text.unicode(), ch = s, e = text.unicode() + text.size(); ch != e; ++ch, ++i) {
+	auto i = int(plain - s);
+	for (auto ch = plain; ch != e; ++ch, ++i) {
 		if (ch->unicode() < 128) {
 			if (copying) result[i] = *ch;
 			continue;
@@ -1406,13 +1646,14 @@ QString RemoveEmoji(const QString &text) {
 QStringList PrepareSearchWords(
 		const QString &query,
 		const QRegularExpression *SplitterOverride) {
-	auto clean = RemoveAccents(query.trimmed().toLower());
+	auto clean = PrepareSearchText(query);
 	auto result = QStringList();
-	if (!clean.isEmpty()) {
-		auto list = clean.split(SplitterOverride
-			? *SplitterOverride
-			: RegExpWordSplit(),
-			Qt::SkipEmptyParts);
+	if (!SplitterOverride) {
+		EnumerateSearchWords(clean, [&](QStringView word) {
+			result.push_back(word.toString());
+		});
+	} else if (!clean.isEmpty()) {
+		auto list = clean.split(*SplitterOverride, Qt::SkipEmptyParts);
 		result.reserve(list.size());
 		for (const auto &word : std::as_const(list)) {
 			auto trimmed = word.trimmed();
@@ -1424,25 +1665,76 @@ QStringList PrepareSearchWords(
 	return result;
 }
 
-bool CutPart(TextWithEntities &sending, TextWithEntities &left, int32 limit) {
+bool IsSearchWordSeparator(QChar ch) {
+	// Whitespace and [@\-+()[\]{}<>,.:!_;"'\x0].
+	switch (ch.unicode()) {
+	case ' ':
+	case '\t':
+	case '\n':
+	case '\v':
+	case '\f':
+	case '\r':
+	case '@':
+	case '-':
+	case '+':
+	case '(':
+	case ')':
+	case '[':
+	case ']':
+	case '{':
+	case '}':
+	case '<':
+	case '>':
+	case ',':
+	case '.':
+	case ':':
+	case '!':
+	case '_':
+	case ';':
+	case '"':
+	case '\'':
+	case 0:
+		return true;
+	}
+	return false;
+}
+
+QString PrepareSearchText(const QString &query) {
+	return RemoveAccents(query.trimmed().toLower());
+}
+
+TextWithEntitiesCutter::TextWithEntitiesCutter(const TextWithEntities &text)
+: _text(text) {
+}
+
+bool TextWithEntitiesCutter::empty() const {
+	return (_from >= _text.text.size());
+}
+
+TextWithEntities TextWithEntitiesCutter::cut(int limit) {
 	Expects(limit > 0);
 
-	if (left.text.isEmpty()) {
-		return false;
-	}
+	const auto &entities = _text.entities;
+	const auto base = _from;
+	const auto entityFrom = [&](int index) {
+		return std::max(entities[index].offset() - base, 0);
+	};
+	const auto entityTill = [&](int index) {
+		return entities[index].offset() + entities[index].length() - base;
+	};
 
-	int32 currentEntity = 0, goodEntity = currentEntity, entityCount = left.entities.size();
+	int32 currentEntity = _entitiesFrom, goodEntity = currentEntity, entityCount = entities.size();
 	bool goodInEntity = false, goodCanBreakEntity = false;
 
 	int32 s = 0, half = limit / 2, goodLevel = 0;
-	for (const QChar *start = left.text.constData(), *ch = start, *end = left.text.constEnd(), *good = ch; ch != end; ++ch, ++s) {
-		while (currentEntity < entityCount && ch >= start + left.entities[currentEntity].offset() + left.entities[currentEntity].length()) {
+	for (const QChar *start = _text.text.constData() + base, *ch = start, *end = _text.text.constEnd(), *good = ch; ch != end; ++ch, ++s) {
+		while (currentEntity < entityCount && ch >= start + entityTill(currentEntity)) {
 			++currentEntity;
 		}
 
 		if (s > half) {
-			bool inEntity = (currentEntity < entityCount) && (ch > start + left.entities[currentEntity].offset()) && (ch < start + left.entities[currentEntity].offset() + left.entities[currentEntity].length());
-			EntityType entityType = (currentEntity < entityCount) ? left.entities[currentEntity].type() : EntityType::Invalid;
+			bool inEntity = (currentEntity < entityCount) && (ch > start + entityFrom(currentEntity)) && (ch < start + entityTill(currentEntity));
+			EntityType entityType = (currentEntity < entityCount) ? entities[currentEntity].type() : EntityType::Invalid;
 			bool canBreakEntity = (entityType == EntityType::Pre)
 				|| (entityType == EntityType::Blockquote)
 				|| (entityType == EntityType::Code); // #TODO entities
@@ -1472,14 +1764,14 @@ bool CutPart(TextWithEntities &sending, TextWithEntities &left, int32 limit) {
 					} else if (ch + 1 < end && IsNewline(*(ch + 1))) {
 						markGoodAsLevel(15);
 					} else if (currentEntity < entityCount
-						&& ch + 1 == start + left.entities[currentEntity].offset()
-						&& (left.entities[currentEntity].type() == EntityType::Pre
-							|| left.entities[currentEntity].type() == EntityType::Blockquote)) {
+						&& ch + 1 == start + entityFrom(currentEntity)
+						&& (entities[currentEntity].type() == EntityType::Pre
+							|| entities[currentEntity].type() == EntityType::Blockquote)) {
 						markGoodAsLevel(14);
-					} else if (currentEntity > 0
-						&& ch == start + left.entities[currentEntity - 1].offset() + left.entities[currentEntity - 1].length()
-						&& (left.entities[currentEntity - 1].type() == EntityType::Pre
-							|| left.entities[currentEntity - 1].type() == EntityType::Blockquote)) {
+					} else if (currentEntity > _entitiesFrom
+						&& ch == start + entityTill(currentEntity - 1)
+						&& (entities[currentEntity - 1].type() == EntityType::Pre
+							|| entities[currentEntity - 1].type() == EntityType::Blockquote)) {
 						markGoodAsLevel(14);
 					} else {
 						markGoodAsLevel(13);
@@ -1514,34 +1806,74 @@ bool CutPart(TextWithEntities &sending, TextWithEntities &left, int32 limit) {
 			++ch;
 		}
 		if (s >= limit) {
-			sending.text = left.text.mid(0, good - start);
-			left.text = left.text.mid(good - start);
-			if (goodInEntity) {
-				if (goodCanBreakEntity) {
-					sending.entities = left.entities.mid(0, goodEntity + 1);
-					sending.entities.back().updateTextEnd(good - start);
-					left.entities = left.entities.mid(goodEntity);
-					for (auto &entity : left.entities) {
-						entity.shiftLeft(good - start);
-					}
-				} else {
-					sending.entities = left.entities.mid(0, goodEntity);
-					left.entities = left.entities.mid(goodEntity + 1);
-				}
-			} else {
-				sending.entities = left.entities.mid(0, goodEntity);
-				left.entities = left.entities.mid(goodEntity);
-				for (auto &entity : left.entities) {
-					entity.shiftLeft(good - start);
-				}
+			if (good == start) {
+				// Nothing to cut by, like a single emoji longer than limit.
+				good = ch + 1;
+				goodEntity = currentEntity;
+				goodInEntity = false;
 			}
-			return true;
+			const auto length = int(good - start);
+			const auto breakEntity = goodInEntity && goodCanBreakEntity;
+			auto result = take(
+				length,
+				breakEntity ? (goodEntity + 1) : goodEntity);
+			if (breakEntity) {
+				result.entities.back().updateTextEnd(length);
+			}
+			_entitiesFrom = (goodInEntity && !goodCanBreakEntity)
+				? (goodEntity + 1)
+				: goodEntity;
+			_from = base + length;
+			return result;
 		}
 	}
-	sending = base::take(left);
+	auto result = take(_text.text.size() - base, entities.size());
+	_from = _text.text.size();
+	_entitiesFrom = entities.size();
+	return result;
+}
+
+TextWithEntities TextWithEntitiesCutter::left() const {
+	return take(_text.text.size() - _from, _text.entities.size());
+}
+
+TextWithEntities TextWithEntitiesCutter::take(
+		int length,
+		int entitiesTill) const {
+	auto result = TextWithEntities{ _text.text.mid(_from, length) };
+	result.entities.reserve(entitiesTill - _entitiesFrom);
+	for (auto i = _entitiesFrom; i < entitiesTill; ++i) {
+		result.entities.push_back(_text.entities[i]);
+		result.entities.back().shiftLeft(_from);
+	}
+	return result;
+}
+
+bool CutPart(TextWithEntities &sending, TextWithEntities &left, int32 limit) {
+	Expects(limit > 0);
+
+	if (left.text.isEmpty()) {
+		return false;
+	}
+	auto cutter = TextWithEntitiesCutter(left);
+	sending = cutter.cut(limit);
+	left = cutter.left();
 	return true;
 }
 
+std::vector<TextWithEntities> CutParts(
+		const TextWithEntities &text,
+		int limit) {
+	Expects(limit > 0);
+
+	auto result = std::vector<TextWithEntities>();
+	auto cutter = TextWithEntitiesCutter(text);
+	while (!cutter.empty()) {
+		result.push_back(cutter.cut(limit));
+	}
+	return result;
+}
+
 MentionNameFields MentionNameDataToFields(QStringView data) {
 	const auto components = data.split('.');
 	if (components.size() != 2) {
@@ -1586,12 +1918,18 @@ void ParseEntities(TextWithEntities &result, int32 flags) {
 	int32 len = result.text.size();
 	const auto start = result.text.constData();
 	const auto end = start + result.text.size();
+	auto domainMatcher = ForwardMatcher(qthelp::RegExpDomain());
+	auto explicitDomainMatcher = ForwardMatcher(
+		qthelp::RegExpDomainExplicit());
+	auto hashtagMatcher = ForwardMatcher(RegExpHashtag());
+	auto mentionMatcher = ForwardMatcher(RegExpMention());
+	auto botCommandMatcher = ForwardMatcher(RegExpBotCommand());
 	for (int32 offset = 0, matchOffset = offset, mentionSkip = 0; offset < len;) {
-		auto mDomain = qthelp::RegExpDomain().match(result.text, matchOffset);
-		auto mExplicitDomain = qthelp::RegExpDomainExplicit().match(result.text, matchOffset);
-		auto mHashtag = withHashtags ? RegExpHashtag().match(result.text, matchOffset) : QRegularExpressionMatch();
-		auto mMention = withMentions ? RegExpMention().match(result.text, qMax(mentionSkip, matchOffset)) : QRegularExpressionMatch();
-		auto mBotCommand = withBotCommands ? RegExpBotCommand().match(result.text, matchOffset) : QRegularExpressionMatch();
+		auto mDomain = domainMatcher.match(result.text, matchOffset);
+		auto mExplicitDomain = explicitDomainMatcher.match(result.text, matchOffset);
+		auto mHashtag = withHashtags ? hashtagMatcher.match(result.text, matchOffset) : QRegularExpressionMatch();
+		auto mMention = withMentions ? mentionMatcher.match(result.text, qMax(mentionSkip, matchOffset)) : QRegularExpressionMatch();
+		auto mBotCommand = withBotCommands ? botCommandMatcher.match(result.text, matchOffset) : QRegularExpressionMatch();
 
 		auto lnkType = EntityType::Url;
 		int32 lnkStart = 0, lnkLength = 0;
@@ -1635,7 +1973,7 @@ void ParseEntities(TextWithEntities &result, int32 flags) {
 					&& (start + mentionSkip)->isLowSurrogate()) {
 					++mentionSkip;
 				}
-				mMention = RegExpMention().match(result.text, qMax(mentionSkip, matchOffset));
+				mMention = mentionMatcher.match(result.text, qMax(mentionSkip, matchOffset));
 				if (mMention.hasMatch()) {
 					mentionStart = mMention.capturedStart();
 					mentionEnd = mMention.capturedEnd();
@@ -1853,7 +2191,7 @@ void Trim(TextWithEntities &result) {
 	auto foundNotTrimmedChar = false;
 
 	// right trim
-	for (auto s = result.text.data(), e = s + result.text.size(), ch = e; ch != s;) {
+	for (auto s = result.text.constData(), e = s + result.text.size(), ch = e; ch != s;) {
 		--ch;
 		if (!IsTrimmed(*ch)) {
 			if (ch + 1 < e) {
@@ -1877,7 +2215,7 @@ void Trim(TextWithEntities &result) {
 		result.text.size());
 
 	// left trim
-	for (auto s = result.text.data(), ch = s, e = s + result.text.size(); ch != e; ++ch) {
+	for (auto s = result.text.constData(), ch = s, e = s + result.text.size(); ch != e; ++ch) {
 		if (!IsTrimmed(*ch) || (ch - s) == firstMonospaceOffset) {
 			if (ch > s) {
 				auto l = ch - s;
@@ -1955,6 +2293,97 @@ TextWithTags::Tags DeserializeTags(QByteArray data, int textLength) {
 	return result;
 }
 
+QByteArray SerializeTagsCompact(const TextWithTags::Tags &tags) {
+	if (tags.isEmpty()) {
+		return QByteArray();
+	}
+	auto writer = CompactWriter(tags.size());
+	for (const auto &tag : tags) {
+		writer.range(tag.offset, tag.length);
+		writer.string(tag.id);
+	}
+	return writer.result();
+}
+
+bool DeserializeTagsCompact(
+		const QByteArray &data,
+		int textLength,
+		TextWithTags::Tags &to) {
+	to.clear();
+	if (data.isEmpty()) {
+		return true;
+	}
+	auto reader = CompactReader(data, textLength);
+	auto count = 0;
+	if (!reader.start(count)) {
+		return false;
+	}
+	to.reserve(count);
+	for (auto i = 0; i != count; ++i) {
+		auto tag = TextWithTags::Tag();
+		if (!reader.range(tag.offset, tag.length)
+			|| !reader.string(tag.id)) {
+			to.clear();
+			return false;
+		}
+		to.push_back(std::move(tag));
+	}
+	if (!reader.finished()) {
+		to.clear();
+		return false;
+	}
+	return true;
+}
+
+QByteArray SerializeEntitiesCompact(const EntitiesInText &entities) {
+	if (entities.isEmpty()) {
+		return QByteArray();
+	}
+	auto writer = CompactWriter(entities.size());
+	for (const auto &entity : entities) {
+		writer.range(entity.offset(), entity.length());
+		writer.byte(uchar(entity.type()));
+		writer.string(entity.data());
+	}
+	return writer.result();
+}
+
+bool DeserializeEntitiesCompact(
+		const QByteArray &data,
+		int textLength,
+		EntitiesInText &to) {
+	to.clear();
+	if (data.isEmpty()) {
+		return true;
+	}
+	auto reader = CompactReader(data, textLength);
+	auto count = 0;
+	if (!reader.start(count)) {
+		return false;
+	}
+	to.reserve(count);
+	for (auto i = 0; i != count; ++i) {
+		auto offset = 0;
+		auto length = 0;
+		auto type = uchar();
+		auto entityData = QString();
+		if (!reader.range(offset, length)
+			|| !reader.byte(type)
+			|| type == uchar(EntityType::Invalid)
+			|| type > uchar(EntityType::Spoiler)
+			|| !reader.string(entityData)) {
+			to.clear();
+			return false;
+		}
+		to.push_back({ EntityType(type), offset, length, entityData });
+	}
+	if (!reader.finished()) {
+		to.clear();
+		return false;
+	}
+	return true;
+}
+
 QString TagsMimeType() {
 	return QString::fromLatin1("application/x-td-field-tags");
 }
@@ -317,7 +317,49 @@ TextWithEntities SingleLine(const TextWithEntities &text);
 QString RemoveAccents(const QString &text);
 QString RemoveEmoji(const QString &text);
 QStringList PrepareSearchWords(const QString &query, const QRegularExpression *SplitterOverride = nullptr);
+
+// Search words without allocations, same as in PrepareSearchWords.
+[[nodiscard]] bool IsSearchWordSeparator(QChar ch);
+[[nodiscard]] QString PrepareSearchText(const QString &query);
+template <typename Callback>
+void EnumerateSearchWords(QStringView prepared, Callback &&callback) {
+	const auto till = prepared.size();
+	for (auto from = qsizetype(0); from != till;) {
+		auto i = from;
+		while (i != till && !IsSearchWordSeparator(prepared[i])) {
+			++i;
+		}
+		const auto word = prepared.mid(from, i - from).trimmed();
+		if (!word.isEmpty()) {
+			callback(word);
+		}
+		from = (i != till) ? (i + 1) : i;
+	}
+}
+
 bool CutPart(TextWithEntities &sending, TextWithEntities &left, int limit);
+[[nodiscard]] std::vector<TextWithEntities> CutParts(
+	const TextWithEntities &text,
+	int limit);
+
+// Cuts parts from the beginning of a text the same way CutPart does,
+// but keeps a position in the original instead of copying the rest.
+class TextWithEntitiesCutter final {
+public:
+	explicit TextWithEntitiesCutter(const TextWithEntities &text);
+
+	[[nodiscard]] bool empty() const;
+	[[nodiscard]] TextWithEntities cut(int limit);
+	[[nodiscard]] TextWithEntities left() const;
+
+private:
+	[[nodiscard]] TextWithEntities take(int length, int entitiesTill) const;
+
+	const TextWithEntities &_text;
+	int _from = 0;
+	int _entitiesFrom = 0;
+
+};
 
 struct MentionNameFields {
 	uint64 selfId = 0;
@@ -355,6 +397,19 @@ void ApplyServerCleaning(TextWithEntities &result);
 [[nodiscard]] TextWithTags::Tags DeserializeTags(
 	QByteArray data,
 	int textLength);
+
+// Versioned varint format, deserialized into the passed vectors.
+[[nodiscard]] QByteArray SerializeTagsCompact(const TextWithTags::Tags &tags);
+[[nodiscard]] bool DeserializeTagsCompact(
+	const QByteArray &data,
+	int textLength,
+	TextWithTags::Tags &to);
+[[nodiscard]] QByteArray SerializeEntitiesCompact(
+	const EntitiesInText &entities);
+[[nodiscard]] bool DeserializeEntitiesCompact(
+	const QByteArray &data,
+	int textLength,
+	EntitiesInText &to);
 [[nodiscard]] QString TagsMimeType();
 [[nodiscard]] QString TagsTextMimeType();
 
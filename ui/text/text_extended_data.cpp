@@ -35,8 +35,8 @@ void SpoilerClickHandler::onClick(ClickContext context) const {
 
 PreClickHandler::PreClickHandler(
 	not_null<String*> text,
-	uint16 offset,
-	uint16 length)
+	int offset,
+	int length)
 : _text(text)
 , _offset(offset)
 , _length(length) {
@@ -54,7 +54,7 @@ void PreClickHandler::onClick(ClickContext context) const {
 	if (context.button != Qt::LeftButton) {
 		return;
 	}
-	const auto till = uint16(_offset + _length);
+	const auto till = _offset + _length;
 	auto text = _text->toTextForMimeData({ _offset, till });
 	if (text.empty()) {
 		return;
@@ -34,7 +34,7 @@ private:
 
 class PreClickHandler final : public ClickHandler {
 public:
-	PreClickHandler(not_null<String*> text, uint16 offset, uint16 length);
+	PreClickHandler(not_null<String*> text, int offset, int length);
 
 	[[nodiscard]] not_null<String*> text() const;
 	void setText(not_null<String*> text);
@@ -43,8 +43,8 @@ public:
 
 private:
 	not_null<String*> _text;
-	uint16 _offset = 0;
-	uint16 _length = 0;
+	int _offset = 0;
+	int _length = 0;
 
 };
 
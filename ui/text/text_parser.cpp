@@ -21,6 +21,44 @@ namespace {
 constexpr auto kStringLinkIndexShift = uint16(0x8000);
 constexpr auto kMaxDiacAfterSymbol = 2;
 
+// Long runs of plain text are split into several text blocks so that word
+// offsets fit in 16 bits. The split point is looked for in the last part of
+// the block, after a space or another break opportunity.
+constexpr auto kSplitTextBlockLength = kMaxTextBlockLength - 0x1000;
+constexpr auto kForceSplitTextBlockLength = kMaxTextBlockLength - 0x10;
+
+[[nodiscard]] bool IsBlockSplitOpportunity(QChar ch) {
+	if (ch == QChar::Space || ch == QChar::Tabulation) {
+		return true;
+	}
+	const auto script = ch.script();
+	return (script == QChar::Script_Han)
+		|| (script == QChar::Script_Hiragana)
+		|| (script == QChar::Script_Katakana);
+}
+
+// Returns the position in (from, till] to end the block at.
+[[nodiscard]] int FindBlockSplit(const QString &text, int from, int till) {
+	const auto data = text.constData();
+	for (auto i = till; i > from; --i) {
+		if (IsBlockSplitOpportunity(data[i - 1])
+			&& !data[i - 1].isHighSurrogate()
+			&& (i == text.size() || !IsDiacritic(data[i]))) {
+			return i;
+		}
+	}
+	// No break opportunity, split anywhere outside of a surrogate pair
+	// and not right before a diacritic.
+	for (auto i = till; i > from; --i) {
+		if (!data[i - 1].isHighSurrogate()
+			&& (i == text.size()
+				|| (!data[i].isLowSurrogate() && !IsDiacritic(data[i])))) {
+			return i;
+		}
+	}
+	return till;
+}
+
 [[nodiscard]] TextWithEntities PrepareRichFromRich(
 		const TextWithEntities &text,
 		const TextParseOptions &options) {
@@ -91,6 +129,22 @@ constexpr auto kMaxDiacAfterSymbol = 2;
 		&& (category != QChar::Other_NotAssigned);
 }
 
+// Printable ASCII, measured the same way in every String.
+[[nodiscard]] bool IsSimpleText(const QString &text, int from, int length) {
+	for (const auto ch : base::StringViewMid(text, from, length)) {
+		const auto code = ch.unicode();
+		if (code < 0x20 || code > 0x7E) {
+			return false;
+		}
+	}
+	return true;
+}
+
+[[nodiscard]] TextBlockMeasureCache &SimpleTextBlocksCache() {
+	static auto result = TextBlockMeasureCache();
+	return result;
+}
+
 } // namespace
 
 Parser::StartedEntity::StartedEntity(TextBlockFlags flags)
@@ -137,12 +191,16 @@ Parser::Parser(
 	not_null<String*> string,
 	const TextWithEntities &textWithEntities,
 	const TextParseOptions &options,
-	const std::any &context)
+	const std::any &context,
+	bool measure,
+	TextBlockMeasureCache *cache)
 : Parser(
 	string,
 	PrepareRichFromRich(textWithEntities, options),
 	options,
 	context,
+	measure,
+	cache,
 	ReadyToken()) {
 }
 
@@ -151,6 +209,8 @@ Parser::Parser(
 	TextWithEntities &&source,
 	const TextParseOptions &options,
 	const std::any &context,
+	bool measure,
+	TextBlockMeasureCache *cache,
 	ReadyToken)
 : _t(string)
 , _source(std::move(source))
@@ -161,12 +221,18 @@ Parser::Parser(
 , _entitiesEnd(_source.entities.end())
 , _waitingEntity(_source.entities.begin())
 , _multiline(options.flags & TextParseMultiline)
+, _measure(measure)
+, _cache(cache)
 , _stopAfterWidth(ComputeStopAfter(options, *_t->_st))
 , _checkTilde(ComputeCheckTilde(*_t->_st)) {
 	parse(options);
 }
 
 void Parser::blockCreated() {
+	if (!_measure) {
+		// Text blocks have no width yet, so we parse the text till the end.
+		return;
+	}
 	_sumWidth += _t->_blocks.back()->f_width();
 	if (_sumWidth.floor().toInt() > _stopAfterWidth) {
 		_sumFinished = true;
@@ -224,7 +290,22 @@ void Parser::createBlock(int32 skipBack) {
 		auto &newline = _t->_blocks.back().unsafe<NewlineBlock>();
 		newline._quoteIndex = _quoteIndex;
 	} else {
-		push(&Block::Text, _t->_minResizeWidth);
+		push(&Block::Text);
+		if (_measure) {
+			const auto cache = _cache
+				? _cache
+				: (TextBlockMeasureCache::Cacheable(length)
+					&& IsSimpleText(_t->_text, _blockStart, length))
+				? &SimpleTextBlocksCache()
+				: nullptr;
+			_t->_blocks.back().unsafe<TextBlock>().measure(
+				_t->_st->font,
+				_t->_text,
+				length,
+				_t->_minResizeWidth,
+				_t->_words,
+				cache);
+		}
 	}
 	// Diacritic can't attach from the next block to this one.
 	_allowDiacritic = false;
@@ -234,6 +315,27 @@ void Parser::createBlock(int32 skipBack) {
 	blockCreated();
 }
 
+void Parser::splitLongTextBlock() {
+	if (_emoji || !_customEmojiData.isEmpty()) {
+		return;
+	}
+	const auto till = int32(_t->_text.size());
+	if (till - _blockStart < kForceSplitTextBlockLength) {
+		return;
+	}
+	const auto split = FindBlockSplit(
+		_t->_text,
+		_blockStart + kSplitTextBlockLength,
+		till);
+
+	// The tail stays in the current block, keep its diacritic state.
+	const auto allowDiacritic = _allowDiacritic;
+	createBlock(split - till);
+	if (split < till) {
+		_allowDiacritic = allowDiacritic;
+	}
+}
+
 void Parser::createNewlineBlock(bool fromOriginalText) {
 	if (!fromOriginalText) {
 		_t->insertModifications(_t->_text.size(), 1);
@@ -650,11 +752,13 @@ void Parser::parse(const TextParseOptions &options) {
 		parseCurrentChar();
 		parseEmojiFromCurrent();
 
-		if (_sumFinished || _t->_text.size() >= 0x8000) {
-			break; // 32k max
+		if (_sumFinished) {
+			break;
 		}
+		splitLongTextBlock();
 	}
 	createBlock();
+	_t->_words.shrink_to_fit();
 	finalize(options);
 }
 
@@ -706,7 +810,7 @@ void Parser::finalize(const TextParseOptions &options) {
 	_t->_isIsolatedEmoji = true;
 	_t->_isOnlyCustomEmoji = true;
 	_t->_hasNotEmojiAndSpaces = false;
-	auto spacesCheckFrom = uint16(-1);
+	auto spacesCheckFrom = -1;
 	const auto length = int(_t->_text.size());
 	for (auto &block : _t->_blocks) {
 		if (block->type() == TextBlockType::CustomEmoji) {
@@ -719,10 +823,10 @@ void Parser::finalize(const TextParseOptions &options) {
 		}
 		if (!_t->_hasNotEmojiAndSpaces) {
 			if (block->type() == TextBlockType::Text) {
-				if (spacesCheckFrom == uint16(-1)) {
+				if (spacesCheckFrom < 0) {
 					spacesCheckFrom = block->position();
 				}
-			} else if (spacesCheckFrom != uint16(-1)) {
+			} else if (spacesCheckFrom >= 0) {
 				const auto checkTill = block->position();
 				for (auto i = spacesCheckFrom; i != checkTill; ++i) {
 					Assert(i < length);
@@ -731,7 +835,7 @@ void Parser::finalize(const TextParseOptions &options) {
 						break;
 					}
 				}
-				spacesCheckFrom = uint16(-1);
+				spacesCheckFrom = -1;
 			}
 		}
 		if (_t->_isIsolatedEmoji) {
@@ -820,7 +924,7 @@ void Parser::finalize(const TextParseOptions &options) {
 	if (_t->_blocks.empty() || hasSpoiler) {
 		_t->_isIsolatedEmoji = false;
 	}
-	if (!_t->_hasNotEmojiAndSpaces && spacesCheckFrom != uint16(-1)) {
+	if (!_t->_hasNotEmojiAndSpaces && spacesCheckFrom >= 0) {
 		Assert(spacesCheckFrom < length);
 		for (auto i = spacesCheckFrom; i != length; ++i) {
 			Assert(i < length);
@@ -19,7 +19,9 @@ public:
 		not_null<String*> string,
 		const TextWithEntities &textWithEntities,
 		const TextParseOptions &options,
-		const std::any &context);
+		const std::any &context,
+		bool measure = true,
+		TextBlockMeasureCache *cache = nullptr);
 
 private:
 	struct ReadyToken {
@@ -54,11 +56,14 @@ private:
 		TextWithEntities &&source,
 		const TextParseOptions &options,
 		const std::any &context,
+		bool measure,
+		TextBlockMeasureCache *cache,
 		ReadyToken);
 
 	void trimSourceRange();
 	void blockCreated();
 	void createBlock(int32 skipBack = 0);
+	void splitLongTextBlock();
 	void createNewlineBlock(bool fromOriginalText);
 	void ensureAtNewline(QuoteDetails quote);
 
@@ -95,6 +100,8 @@ private:
 	EntitiesInText::const_iterator _waitingEntity;
 	QString _customEmojiData;
 	const bool _multiline = false;
+	const bool _measure = true;
+	TextBlockMeasureCache * const _cache = nullptr;
 
 	const QFixed _stopAfterWidth; // summary width of all added words
 	const bool _checkTilde = false; // do we need a special text block for tilde symbol
@@ -13,6 +13,9 @@
 #include <private/qharfbuzz_p.h>
 #endif // Qt < 6.0.0
 
+#include <list>
+#include <unordered_map>
+
 namespace Ui::Text {
 namespace {
 
@@ -34,6 +37,8 @@ struct BidiStatus {
 enum { _MaxBidiLevel = 61 };
 enum { _MaxItemLength = 4096 };
 
+constexpr auto kShapedLinesCacheSize = 256;
+
 void InitTextItemWithScriptItem(QTextItemInt &ti, const QScriptItem &si) {
 	// explicitly initialize flags so that initFontAttributes can be called
 	// multiple times on the same TextItem
@@ -84,6 +89,129 @@ void AppendRange(
 	ranges.push_back(range);
 }
 
+// Least recently used shaped lines, looked up by the line hash.
+class ShapedLinesCache final {
+public:
+	ShapedLinesCache();
+
+	[[nodiscard]] QTextEngine *find(
+		const ShapedLineKey &key,
+		ShapedLineClusters *&clusters);
+	[[nodiscard]] not_null<QTextEngine*> insert(
+		const ShapedLineKey &key,
+		std::unique_ptr<QTextEngine> engine,
+		ShapedLineClusters *&clusters);
+
+	void clear();
+
+private:
+	struct Entry {
+		std::unique_ptr<QTextEngine> engine;
+		ShapedLineClusters clusters;
+		QString text;
+		std::vector<quintptr> signature;
+		size_t hash = 0;
+		int from = 0;
+		int length = 0;
+		Qt::LayoutDirection direction = Qt::LayoutDirectionAuto;
+	};
+	using Entries = std::list<Entry>;
+
+	[[nodiscard]] static size_t Hash(const ShapedLineKey &key);
+	[[nodiscard]] static bool Matches(
+		const Entry &entry,
+		const ShapedLineKey &key);
+
+	Entries _entries; // Most recently used first.
+	std::unordered_multimap<size_t, Entries::iterator> _byHash;
+	rpl::lifetime _lifetime;
+
+};
+
+ShapedLinesCache::ShapedLinesCache() {
+	_byHash.reserve(kShapedLinesCacheSize);
+	rpl::merge(
+		style::PaletteChanged(),
+		style::ManagerStopping()
+	) | rpl::start_with_next([=] {
+		clear();
+	}, _lifetime);
+}
+
+QTextEngine *ShapedLinesCache::find(
+		const ShapedLineKey &key,
+		ShapedLineClusters *&clusters) {
+	const auto [from, till] = _byHash.equal_range(Hash(key));
+	for (auto i = from; i != till; ++i) {
+		const auto entry = i->second;
+		if (Matches(*entry, key)) {
+			_entries.splice(_entries.begin(), _entries, entry);
+			clusters = &entry->clusters;
+			return entry->engine.get();
+		}
+	}
+	return nullptr;
+}
+
+not_null<QTextEngine*> ShapedLinesCache::insert(
+		const ShapedLineKey &key,
+		std::unique_ptr<QTextEngine> engine,
+		ShapedLineClusters *&clusters) {
+	if (_entries.size() >= kShapedLinesCacheSize) {
+		const auto oldest = std::prev(_entries.end());
+		const auto [from, till] = _byHash.equal_range(oldest->hash);
+		for (auto i = from; i != till; ++i) {
+			if (i->second == oldest) {
+				_byHash.erase(i);
+				break;
+			}
+		}
+		_entries.erase(oldest);
+	}
+	_entries.push_front(Entry{
+		.engine = std::move(engine),
+		.text = key.text,
+		.signature = { key.signature.begin(), key.signature.end() },
+		.hash = Hash(key),
+		.from = key.from,
+		.length = key.length,
+		.direction = key.direction,
+	});
+	const auto entry = _entries.begin();
+	_byHash.emplace(entry->hash, entry);
+	clusters = &entry->clusters;
+	return entry->engine.get();
+}
+
+void ShapedLinesCache::clear() {
+	_byHash.clear();
+	_entries.clear();
+}
+
+size_t ShapedLinesCache::Hash(const ShapedLineKey &key) {
+	auto result = size_t(qHash(key.text));
+	for (const auto value : key.signature) {
+		result = (result * 31) + size_t(value);
+	}
+	return (((result * 31) + key.from) * 31 + key.length) * 31
+		+ size_t(key.direction);
+}
+
+bool ShapedLinesCache::Matches(
+		const Entry &entry,
+		const ShapedLineKey &key) {
+	return (entry.from == key.from)
+		&& (entry.length == key.length)
+		&& (entry.direction == key.direction)
+		&& (entry.text == key.text)
+		&& ranges::equal(entry.signature, key.signature);
+}
+
+[[nodiscard]] ShapedLinesCache &ShapedLines() {
+	static auto result = ShapedLinesCache();
+	return result;
+}
+
 } // namespace
 
 struct Renderer::BidiControl {
@@ -262,7 +390,27 @@ void Renderer::enumerate() {
 	auto blockIndex = 0;
 	bool longWordLine = true;
 	auto e = _t->_blocks.cend();
-	for (auto i = _t->_blocks.cbegin(); i != e; ++i, ++blockIndex) {
+	auto i = _t->_blocks.cbegin();
+	if (!_highlight && _geometry.uniformWidth > 0 && _yFrom > _startTop) {
+		// Start from the last paragraph above the first visible line.
+		const auto start = _t->findParagraphAbove(
+			_geometry.uniformWidth,
+			_breakEverywhere,
+			_yFrom - _startTop);
+		if (start.blockIndex > 0) {
+			blockIndex = start.blockIndex;
+			i += blockIndex;
+			_y = _startTop + start.top;
+			_lineIndex = start.lineIndex;
+			_quoteIndex = 0;
+			_quote = nullptr;
+			_quotePadding = QMargins();
+			const auto newline = static_cast<const NewlineBlock*>(
+				(i - 1)->get());
+			initNextParagraph(i, 0, newline->paragraphDirection());
+		}
+	}
+	for (; i != e; ++i, ++blockIndex) {
 		auto b = i->get();
 		auto _btype = b->type();
 		auto blockHeight = CountBlockHeight(b, _t->_st);
@@ -307,8 +455,8 @@ void Renderer::enumerate() {
 		}
 
 		if (_btype == TextBlockType::Text) {
-			auto t = static_cast<const TextBlock*>(b);
-			if (t->_words.isEmpty()) { // no words in this block, spaces only => layout this block in the same line
+			const auto words = _t->words(static_cast<const TextBlock*>(b));
+			if (words.empty()) { // no words in this block, spaces only => layout this block in the same line
 				_last_rPadding += b->f_rpadding();
 
 				_lineHeight = qMax(_lineHeight, blockHeight);
@@ -318,8 +466,8 @@ void Renderer::enumerate() {
 			}
 
 			auto f_wLeft = _wLeft; // vars for saving state of the last word start
-			auto f_lineHeight = _lineHeight; // f points to the last word-start element of t->_words
-			for (auto j = t->_words.cbegin(), en = t->_words.cend(), f = j; j != en; ++j) {
+			auto f_lineHeight = _lineHeight; // f points to the last word-start element of words
+			for (auto j = words.begin(), en = words.end(), f = j; j != en; ++j) {
 				auto wordEndsHere = (j->f_width() >= 0);
 				auto j_width = wordEndsHere ? j->f_width() : -j->f_width();
 
@@ -352,9 +500,9 @@ void Renderer::enumerate() {
 					j_width = (j->f_width() >= 0) ? j->f_width() : -j->f_width();
 				}
 				const auto lineEnd = !_elidedLine
-					? j->position()
+					? (b->position() + j->offset())
 					: (j + 1 != en)
-					? (j + 1)->position()
+					? (b->position() + (j + 1)->offset())
 					: _t->countBlockEnd(i, e);
 				fillParagraphBg(0);
 				if (!drawLine(lineEnd, i, e)) {
@@ -362,7 +510,7 @@ void Renderer::enumerate() {
 				}
 				_y += _lineHeight;
 				_lineHeight = qMax(0, blockHeight);
-				_lineStart = j->position();
+				_lineStart = b->position() + j->offset();
 				_lineStartBlock = blockIndex;
 				initNextLine();
 
@@ -618,7 +766,7 @@ void Renderer::initParagraphBidi() {
 	}
 }
 
-bool Renderer::drawLine(uint16 _lineEnd, const String::TextBlocks::const_iterator &_endBlockIter, const String::TextBlocks::const_iterator &_end) {
+bool Renderer::drawLine(int _lineEnd, const String::TextBlocks::const_iterator &_endBlockIter, const String::TextBlocks::const_iterator &_end) {
 	_yDelta = (_lineHeight - _fontHeight) / 2;
 	if (_yTo >= 0 && (_y + _yDelta >= _yTo || _y >= _yTo)) {
 		return false;
@@ -664,7 +812,7 @@ bool Renderer::drawLine(uint16 _lineEnd, const String::TextBlocks::const_iterato
 		: 0;
 	_localFrom = _lineStart - extendLeft;
 	const auto extendedLineEnd = (_endBlock && _endBlock->position() < trimmedLineEnd && !_elidedLine)
-		? qMin(uint16(trimmedLineEnd + 2), _t->countBlockEnd(_endBlockIter, _end))
+		? qMin(trimmedLineEnd + 2, _t->countBlockEnd(_endBlockIter, _end))
 		: trimmedLineEnd;
 
 	auto lineText = _t->_text.mid(_localFrom, extendedLineEnd - _localFrom);
@@ -753,16 +901,13 @@ bool Renderer::drawLine(uint16 _lineEnd, const String::TextBlocks::const_iterato
 	}
 
 	_f = _t->_st->font;
-	QStackTextEngine engine(lineText, _f->f);
-	engine.option.setTextDirection(_paragraphDirection);
-	_e = &engine;
-
-	eItemize();
 
 	QScriptLine line;
 	line.from = lineStart;
 	line.length = lineLength;
-	eShapeLine(line);
+
+	auto stackEngine = std::optional<QStackTextEngine>();
+	auto &engine = *shapeLine(stackEngine, lineText, line);
 
 	int firstItem = engine.findItem(line.from), lastItem = engine.findItem(line.from + line.length - 1);
 	int nItems = (firstItem >= 0 && lastItem >= firstItem) ? (lastItem - firstItem + 1) : 0;
@@ -1000,15 +1145,28 @@ bool Renderer::drawLine(uint16 _lineEnd, const String::TextBlocks::const_iterato
 			}
 			_lookupResult.uponSymbol = true;
 			if (_lookupSymbol) {
-				QFixed tmpx = rtl ? (x + itemWidth) : x;
-				for (int ch = 0, g, itemL = itemEnd - itemStart; ch < itemL;) {
-					g = logClusters[itemStart - si.position + ch];
-					QFixed gwidth = glyphs.effectiveAdvance(g);
+				// Binary search for the cluster under the point.
+				const auto &clusters = itemClusters(
+					engine,
+					item,
+					itemStart,
+					itemEnd);
+				const auto &offsets = clusters.offsets;
+				const auto offset = rtl
+					? (x + itemWidth - _lookupX)
+					: (_lookupX - x);
+				const auto till = rtl
+					? std::lower_bound(begin(offsets) + 1, end(offsets), offset)
+					: std::upper_bound(begin(offsets) + 1, end(offsets), offset);
+				if (till != end(offsets)) {
+					const auto index = int(till - begin(offsets)) - 1;
+					const auto gwidth = offsets[index + 1] - offsets[index];
+					const auto tmpx = rtl
+						? (x + itemWidth - offsets[index])
+						: (x + offsets[index]);
 					// ch2 - glyph end, ch - glyph start, (ch2 - ch) - how much chars it takes
-					int ch2 = ch + 1;
-					while ((ch2 < itemL) && (g == logClusters[itemStart - si.position + ch2])) {
-						++ch2;
-					}
+					auto ch = clusters.chars[index];
+					const auto ch2 = clusters.chars[index + 1];
 					for (int charsCount = (ch2 - ch); ch < ch2; ++ch) {
 						QFixed shift1 = QFixed(2 * (charsCount - (ch2 - ch)) + 2) * gwidth / QFixed(2 * charsCount),
 							shift2 = QFixed(2 * (charsCount - (ch2 - ch)) + 1) * gwidth / QFixed(2 * charsCount);
@@ -1024,11 +1182,6 @@ bool Renderer::drawLine(uint16 _lineEnd, const String::TextBlocks::const_iterato
 							return false;
 						}
 					}
-					if (rtl) {
-						tmpx -= gwidth;
-					} else {
-						tmpx += gwidth;
-					}
 				}
 				if (itemEnd > itemStart) {
 					_lookupResult.symbol = _localFrom + itemEnd - 1;
@@ -1416,8 +1569,7 @@ void Renderer::elideSaveBlock(int32 blockIndex, const AbstractBlock *&_endBlock,
 		elideStart, 0,
 		(*_elideSavedBlock)->flags(),
 		(*_elideSavedBlock)->linkIndex(),
-		(*_elideSavedBlock)->colorIndex(),
-		QFIXED_MAX);
+		(*_elideSavedBlock)->colorIndex());
 	_blocksSize = blockIndex + 1;
 	_endBlock = (blockIndex + 1 < _t->_blocks.size())
 		? _t->_blocks[blockIndex + 1].get()
@@ -1520,7 +1672,7 @@ void Renderer::prepareElidedLine(
 					if (lineText.size() <= pos || repeat > 3) {
 						lineText += kQEllipsis;
 						lineLength = _localFrom + pos + kQEllipsis.size() - _lineStart;
-						_selection.to = qMin(_selection.to, uint16(_localFrom + pos));
+						_selection.to = qMin(_selection.to, _localFrom + pos);
 						_indexOfElidedBlock = blockIndex + (nextBlock ? 1 : 0);
 						setElideBidi(_localFrom + pos, kQEllipsis.size());
 						_blocksSize = blockIndex;
@@ -1541,7 +1693,7 @@ void Renderer::prepareElidedLine(
 	}
 
 	int32 elideStart = _localFrom + lineText.size();
-	_selection.to = qMin(_selection.to, uint16(elideStart));
+	_selection.to = qMin(_selection.to, elideStart);
 	_indexOfElidedBlock = blockIndex + (nextBlock ? 1 : 0);
 	setElideBidi(elideStart, kQEllipsis.size());
 
@@ -1619,7 +1771,105 @@ void Renderer::eShapeLine(const QScriptLine &line) {
 	}
 }
 
-void Renderer::eSetFont(const AbstractBlock *block) {
+not_null<QTextEngine*> Renderer::shapeLine(
+		std::optional<QStackTextEngine> &stackEngine,
+		const QString &lineText,
+		const QScriptLine &line) {
+	const auto shape = [&](not_null<QTextEngine*> engine) {
+		engine->option.setTextDirection(_paragraphDirection);
+		_e = engine;
+		eItemize();
+		eShapeLine(line);
+		return engine;
+	};
+
+	// Elided lines are shaped with temporarily replaced blocks.
+	if (_elidedLine || _elideSavedBlock) {
+		_uncachedLineClusters.clear();
+		_lineClusters = &_uncachedLineClusters;
+		return shape(&stackEngine.emplace(lineText, _f->f));
+	}
+
+	auto signature = ShapedLineSignature();
+	fillShapedLineSignature(signature, lineText.size());
+	const auto key = ShapedLineKey{
+		.text = lineText,
+		.signature = signature,
+		.from = line.from,
+		.length = line.length,
+		.direction = _paragraphDirection,
+	};
+	auto &cache = ShapedLines();
+	if (const auto engine = cache.find(key, _lineClusters)) {
+		// Restore the state a freshly constructed engine would have.
+		_e = engine;
+		_e->fnt = _f->f;
+		_e->resetFontEngineCache();
+		return engine;
+	}
+	auto owned = std::make_unique<QTextEngine>(lineText, _f->f);
+	shape(owned.get());
+	return cache.insert(key, std::move(owned), _lineClusters);
+}
+
+const ShapedItemClusters &Renderer::itemClusters(
+		QTextEngine &engine,
+		int item,
+		int itemStart,
+		int itemEnd) {
+	Expects(_lineClusters != nullptr);
+
+	const auto i = _lineClusters->find(item);
+	if (i != end(*_lineClusters)) {
+		return i->second;
+	}
+	const auto &si = engine.layoutData->items.at(item);
+	const auto logClusters = engine.logClusters(&si) + itemStart - si.position;
+	const auto glyphs = engine.shapedGlyphs(&si);
+	auto result = ShapedItemClusters();
+	auto x = QFixed();
+	for (auto ch = 0, count = itemEnd - itemStart; ch < count;) {
+		const auto g = logClusters[ch];
+		result.chars.push_back(ch);
+		result.offsets.push_back(x);
+		x += glyphs.effectiveAdvance(g);
+		while (ch < count && logClusters[ch] == g) {
+			++ch;
+		}
+	}
+	result.chars.push_back(itemEnd - itemStart);
+	result.offsets.push_back(x);
+	return _lineClusters->emplace(item, std::move(result)).first->second;
+}
+
+void Renderer::fillShapedLineSignature(
+		ShapedLineSignature &signature,
+		int length) const {
+	const auto till = _localFrom + length;
+	signature.push_back(reinterpret_cast<quintptr>(_f.get()));
+	for (auto i = _lineStartBlock; i < _blocksSize; ++i) {
+		const auto block = _t->_blocks[i].get();
+		if (block->position() >= till) {
+			break;
+		}
+		const auto position = std::max(block->position() - _localFrom, 0);
+		signature.push_back(quintptr(position));
+		signature.push_back(quintptr(block->type()));
+		signature.push_back(quintptr(block->flags().value()));
+		signature.push_back(reinterpret_cast<quintptr>(
+			blockFont(block).get()));
+	}
+	signature.push_back(_paragraphHasBidi ? 1 : 0);
+	if (_paragraphHasBidi) {
+		const auto analysis = _paragraphAnalysis.data()
+			+ (_localFrom - _paragraphStart);
+		for (auto i = 0; i != length; ++i) {
+			signature.push_back(analysis[i].bidiLevel);
+		}
+	}
+}
+
+style::font Renderer::blockFont(const AbstractBlock *block) const {
 	const auto flags = block->flags();
 	const auto usedFont = [&] {
 		if (const auto index = block->linkIndex()) {
@@ -1636,7 +1886,12 @@ void Renderer::eSetFont(const AbstractBlock *block) {
 		}
 		return _t->_st->font;
 	}();
-	const auto newFont = WithFlags(usedFont, flags);
+	return WithFlags(usedFont, flags);
+}
+
+void Renderer::eSetFont(const AbstractBlock *block) {
+	const auto flags = block->flags();
+	const auto newFont = blockFont(block);
 	if (newFont != _f) {
 		_f = (newFont->family() == _t->_st->font->family())
 			? WithFlags(_t->_st->font, flags, newFont->flags())
@@ -30,6 +30,23 @@ struct FixedRange {
 	}
 };
 
+using ShapedLineSignature = QVarLengthArray<quintptr, 64>;
+
+struct ShapedLineKey {
+	const QString &text;
+	const ShapedLineSignature &signature;
+	int from = 0;
+	int length = 0;
+	Qt::LayoutDirection direction = Qt::LayoutDirectionAuto;
+};
+
+// Character clusters of a shaped item in a line, for hit-testing.
+struct ShapedItemClusters {
+	std::vector<int> chars; // Cluster starts from the item start and end.
+	std::vector<QFixed> offsets; // Advance before each cluster and total.
+};
+using ShapedLineClusters = base::flat_map<int, ShapedItemClusters>;
+
 [[nodiscard]] FixedRange Intersected(FixedRange a, FixedRange b);
 [[nodiscard]] bool Intersects(FixedRange a, FixedRange b);
 [[nodiscard]] FixedRange United(FixedRange a, FixedRange b);
@@ -61,7 +78,7 @@ private:
 	void initNextLine();
 	void initParagraphBidi();
 	bool drawLine(
-		uint16 _lineEnd,
+		int _lineEnd,
 		const String::TextBlocks::const_iterator &_endBlockIter,
 		const String::TextBlocks::const_iterator &_end);
 	[[nodiscard]] FixedRange findSelectEmojiRange(
@@ -111,6 +128,21 @@ private:
 
 	void fillParagraphBg(int paddingBottom);
 
+	// Returns an itemized and shaped engine for the current line,
+	// either taken from the shared cache or put into stackEngine.
+	[[nodiscard]] not_null<QTextEngine*> shapeLine(
+		std::optional<QStackTextEngine> &stackEngine,
+		const QString &lineText,
+		const QScriptLine &line);
+	[[nodiscard]] const ShapedItemClusters &itemClusters(
+		QTextEngine &engine,
+		int item,
+		int itemStart,
+		int itemEnd);
+	void fillShapedLineSignature(
+		ShapedLineSignature &signature,
+		int length) const;
+
 	// COPIED FROM qtextengine.cpp AND MODIFIED
 	static void eAppendItems(
 		QScriptAnalysis *analysis,
@@ -120,6 +152,7 @@ private:
 		QChar::Direction dir);
 	void eShapeLine(const QScriptLine &line);
 	void eSetFont(const AbstractBlock *block);
+	[[nodiscard]] style::font blockFont(const AbstractBlock *block) const;
 	void eItemize();
 	QChar::Direction eSkipBoundryNeutrals(
 		QScriptAnalysis *analysis,
@@ -195,6 +228,8 @@ private:
 
 	// current line data
 	QTextEngine *_e = nullptr;
+	ShapedLineClusters *_lineClusters = nullptr;
+	ShapedLineClusters _uncachedLineClusters;
 	style::font _f;
 	int _startLeft = 0;
 	int _startTop = 0;
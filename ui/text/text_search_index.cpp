@@ -0,0 +1,91 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#include "ui/text/text_search_index.h"
+
+#include "ui/text/text_entity.h"
+
+namespace Ui::Text {
+
+void SearchIndex::add(int item, const QString &text) {
+	const auto prepared = TextUtilities::PrepareSearchText(text);
+	const auto offset = int(_words.size());
+	_words.append(prepared);
+	TextUtilities::EnumerateSearchWords(prepared, [&](QStringView word) {
+		_entries.push_back({
+			.from = offset + int(word.data() - prepared.data()),
+			.length = int(word.size()),
+			.item = item,
+		});
+	});
+	_sorted = false;
+}
+
+void SearchIndex::clear() {
+	_words = QString();
+	_entries.clear();
+	_sorted = true;
+}
+
+bool SearchIndex::empty() const {
+	return _entries.empty();
+}
+
+QStringView SearchIndex::word(const Entry &entry) const {
+	return QStringView(_words).mid(entry.from, entry.length);
+}
+
+void SearchIndex::sort() const {
+	if (_sorted) {
+		return;
+	}
+	_sorted = true;
+	ranges::sort(_entries, std::less<>(), [&](const Entry &entry) {
+		return word(entry);
+	});
+}
+
+std::vector<int> SearchIndex::find(const QString &query) const {
+	sort();
+
+	const auto prepared = TextUtilities::PrepareSearchText(query);
+	auto result = std::vector<int>();
+	auto found = std::vector<int>();
+	auto both = std::vector<int>();
+	auto first = true;
+	TextUtilities::EnumerateSearchWords(prepared, [&](QStringView prefix) {
+		if (!first && result.empty()) {
+			return;
+		}
+		found.clear();
+		auto i = ranges::lower_bound(
+			_entries,
+			prefix,
+			std::less<>(),
+			[&](const Entry &entry) { return word(entry); });
+		for (; i != end(_entries) && word(*i).startsWith(prefix); ++i) {
+			found.push_back(i->item);
+		}
+		ranges::sort(found);
+		found.erase(ranges::unique(found), end(found));
+		if (first) {
+			first = false;
+			std::swap(result, found);
+		} else {
+			both.clear();
+			std::set_intersection(
+				begin(result),
+				end(result),
+				begin(found),
+				end(found),
+				std::back_inserter(both));
+			std::swap(result, both);
+		}
+	});
+	return result;
+}
+
+} // namespace Ui::Text
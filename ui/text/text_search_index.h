@@ -0,0 +1,37 @@
+// This file is part of Desktop App Toolkit,
+// a set of libraries for developing nice desktop applications.
+//
+// For license and copyright information please follow this link:
+// https://github.com/desktop-app/legal/blob/master/LEGAL
+//
+#pragma once
+
+namespace Ui::Text {
+
+// Sorted prefix index over the search words of many items.
+// Finds items having words starting with each of the query words.
+class SearchIndex final {
+public:
+	void add(int item, const QString &text);
+	void clear();
+
+	[[nodiscard]] bool empty() const;
+	[[nodiscard]] std::vector<int> find(const QString &query) const;
+
+private:
+	struct Entry {
+		int from = 0;
+		int length = 0;
+		int item = 0;
+	};
+
+	[[nodiscard]] QStringView word(const Entry &entry) const;
+	void sort() const;
+
+	QString _words;
+	mutable std::vector<Entry> _entries;
+	mutable bool _sorted = true;
+
+};
+
+} // namespace Ui::Text
@@ -1323,6 +1323,7 @@ InputField::InputField(
 		_inner->document(),
 		&QTextDocument::contentsChange
 	) | rpl::start_with_next([=](int position, int removed, int added) {
+		accumulateChangedRange(position, removed, added);
 		documentContentsChanged(position, removed, added);
 	}, lifetime());
 	base::qt_signal_producer(
@@ -2047,6 +2048,7 @@ InputField::TextPart InputField::getTextPart(
 		possibleLength += block.length();
 	}
 	auto result = QString();
+	auto replacedObjects = std::vector<ReplacedObject>();
 	result.reserve(possibleLength);
 	if (!full && end < 0) {
 		end = possibleLength;
@@ -2110,6 +2112,7 @@ InputField::TextPart InputField::getTextPart(
 			}
 
 			auto begin = text.data();
+			const auto first = begin;
 			auto ch = begin;
 			auto adjustedLength = text.size();
 			for (const auto end = begin + text.size(); ch != end; ++ch) {
@@ -2127,6 +2130,16 @@ InputField::TextPart InputField::getTextPart(
 						textSizeWithoutSurrogatePairsCount += size
 							- emojiEntry.surrogatePairs;
 					}
+					const auto textPosition = full
+						? fragment.position()
+						: std::max(fragmentPosition, start);
+					replacedObjects.push_back({
+						.position = textPosition + int(ch - first),
+						.extra = int(size),
+						.extraWithoutSurrogatePairs = emojiEntry.text.isEmpty()
+							? 0
+							: int(size - emojiEntry.surrogatePairs),
+					});
 					begin = ch + 1;
 				} break;
 				}
@@ -2156,7 +2169,11 @@ InputField::TextPart InputField::getTextPart(
 	markdownTagAccumulator.finish();
 
 	outTagsChanged = tagAccumulator.changed();
-	return { result, textSizeWithoutSurrogatePairsCount };
+	return {
+		result,
+		textSizeWithoutSurrogatePairsCount,
+		std::move(replacedObjects),
+	};
 }
 
 bool InputField::isUndoAvailable() const {
@@ -2554,22 +2571,176 @@ void InputField::chopByMaxLength(int insertPosition, int insertLength) {
 	}
 }
 
+void InputField::accumulateChangedRange(
+		int position,
+		int removed,
+		int added) {
+	if (!_changedRange) {
+		_changedRange = ChangedRange{
+			.from = position,
+			.till = position + added,
+			.delta = added - removed,
+		};
+		return;
+	}
+	auto &range = *_changedRange;
+	const auto till = (range.till >= position + removed)
+		? (range.till + added - removed)
+		: std::min(range.till, position + added);
+	range.from = std::min(range.from, position);
+	range.till = std::max(till, position + added);
+	range.delta += added - removed;
+}
+
+bool InputField::updateLastTextWithTagsPart(
+		ChangedRange changed,
+		bool &outTextChanged,
+		bool &outTagsChanged) {
+	if (!_lastReplacedObjects || _markdownEnabled) {
+		return false;
+	}
+	const auto document = _inner->document();
+	const auto length = document->characterCount() - 1;
+	if (_lastDocumentLength + changed.delta != length) {
+		return false;
+	}
+
+	// Re-read whole paragraphs touched by the change, starting with the
+	// separator before them, because it takes its tag from the next block.
+	const auto fromBlock = document->findBlock(
+		std::clamp(changed.from, 0, length));
+	const auto tillBlock = document->findBlock(
+		std::clamp(changed.till, 0, length));
+	if (!fromBlock.isValid() || !tillBlock.isValid()) {
+		return false;
+	}
+	const auto from = fromBlock.previous().isValid()
+		? (fromBlock.position() - 1)
+		: fromBlock.position();
+	const auto till = tillBlock.position() + tillBlock.length() - 1;
+	const auto wasTill = till - changed.delta;
+	if (from > till || from > wasTill) {
+		return false;
+	}
+
+	auto &objects = *_lastReplacedObjects;
+	const auto textPosition = [&](int position) {
+		auto result = position;
+		for (const auto &object : objects) {
+			if (object.position >= position) {
+				break;
+			}
+			result += object.extra;
+		}
+		return result;
+	};
+	auto &text = _lastTextWithTags.text;
+	auto &tags = _lastTextWithTags.tags;
+	const auto textFrom = textPosition(from);
+	const auto textTill = textPosition(wasTill);
+	if (textFrom > textTill || textTill > text.size()) {
+		return false;
+	}
+
+	// Tags crossing paragraph separators around the part
+	// could merge with the re-read ones, leave them to a full walk.
+	for (const auto &tag : tags) {
+		const auto tagTill = tag.offset + tag.length;
+		if ((tag.offset < textFrom && tagTill >= textFrom)
+			|| (tag.offset <= textTill && tagTill > textTill)) {
+			return false;
+		}
+	}
+
+	auto partTags = TagList();
+	auto partTagsChanged = false;
+	auto part = getTextPart(from, till, partTags, partTagsChanged);
+
+	const auto shift = int(part.text.size()) - (textTill - textFrom);
+	auto updatedTags = TagList();
+	updatedTags.reserve(tags.size() + partTags.size());
+	for (const auto &tag : tags) {
+		if (tag.offset < textFrom) {
+			updatedTags.push_back(tag);
+		}
+	}
+	for (auto tag : partTags) {
+		tag.offset += textFrom;
+		updatedTags.push_back(std::move(tag));
+	}
+	for (auto tag : tags) {
+		if (tag.offset >= textTill) {
+			tag.offset += shift;
+			updatedTags.push_back(std::move(tag));
+		}
+	}
+	outTagsChanged = (updatedTags != tags);
+	if (outTagsChanged) {
+		tags = std::move(updatedTags);
+	}
+	outTextChanged = (shift != 0)
+		|| (QStringView(text).mid(textFrom, textTill - textFrom)
+			!= QStringView(part.text));
+	if (outTextChanged) {
+		text.replace(textFrom, textTill - textFrom, part.text);
+	}
+
+	auto updatedObjects = std::vector<ReplacedObject>();
+	updatedObjects.reserve(objects.size() + part.replacedObjects.size());
+	for (const auto &object : objects) {
+		if (object.position < from) {
+			updatedObjects.push_back(object);
+		}
+	}
+	updatedObjects.insert(
+		end(updatedObjects),
+		begin(part.replacedObjects),
+		end(part.replacedObjects));
+	for (auto object : objects) {
+		if (object.position >= wasTill) {
+			object.position += changed.delta;
+			updatedObjects.push_back(object);
+		}
+	}
+	objects = std::move(updatedObjects);
+
+	_lastDocumentLength = length;
+	_lastTextSizeWithoutSurrogatePairsCount = length;
+	for (const auto &object : objects) {
+		_lastTextSizeWithoutSurrogatePairsCount
+			+= object.extraWithoutSurrogatePairs;
+	}
+	return true;
+}
+
 void InputField::handleContentsChanged() {
 	setErrorShown(false);
 
+	auto textChanged = false;
 	auto tagsChanged = false;
-	const auto [currentText, currentTextSize] = getTextPart(
-		0,
-		-1,
-		_lastTextWithTags.tags,
-		tagsChanged,
-		_markdownEnabled ? &_lastMarkdownTags : nullptr);
+	const auto changed = base::take(_changedRange);
+	if (!changed
+		|| !updateLastTextWithTagsPart(*changed, textChanged, tagsChanged)) {
+		auto part = getTextPart(
+			0,
+			-1,
+			_lastTextWithTags.tags,
+			tagsChanged,
+			_markdownEnabled ? &_lastMarkdownTags : nullptr);
+
+		_lastTextSizeWithoutSurrogatePairsCount
+			= part.textSizeWithoutSurrogatePairsCount;
+		_lastReplacedObjects = std::move(part.replacedObjects);
+		_lastDocumentLength = _inner->document()->characterCount() - 1;
+		textChanged = (_lastTextWithTags.text != part.text);
+		if (textChanged) {
+			_lastTextWithTags.text = std::move(part.text);
+		}
+	}
 
 	//highlightMarkdown();
 
-	_lastTextSizeWithoutSurrogatePairsCount = currentTextSize;
-	if (tagsChanged || (_lastTextWithTags.text != currentText)) {
-		_lastTextWithTags.text = currentText;
+	if (tagsChanged || textChanged) {
 		const auto weak = MakeWeak(this);
 		_changes.fire({});
 		if (!weak) {
@@ -353,7 +353,26 @@ private:
 	class Inner;
 	friend class Inner;
 
+	// Document range changed since _lastTextWithTags was updated.
+	struct ChangedRange {
+		int from = 0;
+		int till = 0;
+		int delta = 0;
+	};
+
+	// Emoji replaced by ObjectReplacementCharacter in the document.
+	struct ReplacedObject {
+		int position = 0;
+		int extra = 0;
+		int extraWithoutSurrogatePairs = 0;
+	};
+
 	void handleContentsChanged();
+	void accumulateChangedRange(int position, int removed, int added);
+	bool updateLastTextWithTagsPart(
+		ChangedRange changed,
+		bool &outTextChanged,
+		bool &outTagsChanged);
 	bool viewportEventInner(QEvent *e);
 	void handleTouchEvent(QTouchEvent *e);
 
@@ -394,6 +413,7 @@ private:
 	struct TextPart final {
 		QString text;
 		int textSizeWithoutSurrogatePairsCount = 0;
+		std::vector<ReplacedObject> replacedObjects;
 	};
 	TextPart getTextPart(
 		int start,
@@ -500,6 +520,9 @@ private:
 	std::vector<MarkdownTag> _lastMarkdownTags;
 	QString _lastPreEditText;
 	int _lastTextSizeWithoutSurrogatePairsCount = 0;
+	std::optional<std::vector<ReplacedObject>> _lastReplacedObjects;
+	std::optional<ChangedRange> _changedRange;
+	int _lastDocumentLength = 0;
 	std::optional<QString> _inputMethodCommit;
 
 	QMargins _additionalMargins;
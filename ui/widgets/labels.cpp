@@ -853,7 +853,7 @@ void FlatLabel::updateHover(const Text::StateResult &state) {
 		}
 	} else {
 		if (_dragAction == Selecting) {
-			uint16 second = state.symbol;
+			auto second = state.symbol;
 			if (state.afterSymbol && _selectionType == TextSelectType::Letters) {
 				++second;
 			}
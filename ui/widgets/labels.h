@@ -251,7 +251,7 @@ private:
 	};
 	DragAction _dragAction = NoDrag;
 	QPoint _dragStartPosition;
-	uint16 _dragSymbol = 0;
+	int _dragSymbol = 0;
 	bool _dragWasInactive = false;
 
 	QPoint _lastMousePos;